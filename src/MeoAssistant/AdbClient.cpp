@@ -0,0 +1,580 @@
+#include "AdbClient.h"
+
+#ifdef _WIN32
+#include "Utils/Platform/SafeWindows.h"
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+
+#include "Utils/Logger.hpp"
+
+namespace
+{
+#ifdef _WIN32
+    using socket_t = SOCKET;
+    constexpr socket_t InvalidSocket = INVALID_SOCKET;
+    inline void close_socket(socket_t sock)
+    {
+        ::closesocket(sock);
+    }
+    inline int poll_socket(pollfd* fds, unsigned long nfds, int timeout)
+    {
+        return ::WSAPoll(fds, nfds, timeout);
+    }
+    inline bool set_nonblocking(socket_t sock, bool nonblocking)
+    {
+        u_long mode = nonblocking ? 1 : 0;
+        return ::ioctlsocket(sock, FIONBIO, &mode) == 0;
+    }
+    inline bool connect_in_progress()
+    {
+        return ::WSAGetLastError() == WSAEWOULDBLOCK;
+    }
+#else
+    using socket_t = int;
+    constexpr socket_t InvalidSocket = -1;
+    inline void close_socket(socket_t sock)
+    {
+        ::close(sock);
+    }
+    inline int poll_socket(pollfd* fds, nfds_t nfds, int timeout)
+    {
+        return ::poll(fds, nfds, timeout);
+    }
+    inline bool set_nonblocking(socket_t sock, bool nonblocking)
+    {
+        int flags = ::fcntl(sock, F_GETFL, 0);
+        if (flags < 0) {
+            return false;
+        }
+        flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return ::fcntl(sock, F_SETFL, flags) == 0;
+    }
+    inline bool connect_in_progress()
+    {
+        return errno == EINPROGRESS || errno == EINTR;
+    }
+#endif
+
+#ifdef MSG_NOSIGNAL
+    // server 提前关闭连接时不要触发 SIGPIPE
+    constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int SendFlags = 0;
+#endif
+
+    // 一次服务请求对应的连接。adb server 的每个服务都独占一条连接，服务结束后由 server 关闭
+    class AdbSocket
+    {
+    public:
+        explicit AdbSocket(int64_t timeout) { set_timeout(timeout); }
+        AdbSocket(const AdbSocket&) = delete;
+        AdbSocket(AdbSocket&&) = delete;
+        ~AdbSocket()
+        {
+            if (m_socket != InvalidSocket) {
+                close_socket(m_socket);
+            }
+        }
+
+        // 之后的读写都要在 timeout 毫秒内完成
+        void set_timeout(int64_t timeout)
+        {
+            m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        }
+
+        bool connect(const std::string& host, unsigned short port)
+        {
+            m_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (m_socket == InvalidSocket) {
+                asst::Log.error("AdbClient create socket failed");
+                return false;
+            }
+#ifdef SO_NOSIGPIPE
+            int no_sigpipe = 1;
+            ::setsockopt(m_socket, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+                asst::Log.error("AdbClient invalid host", host);
+                return false;
+            }
+            // 阻塞的 connect 不受 timeout 限制，server 不回应（例如端口被防火墙丢包）时会一直卡住
+            // 所以用非阻塞的 connect + poll 等待，连上之后再改回阻塞模式，之后的读写自己用 poll 控制超时
+            if (!set_nonblocking(m_socket, true)) {
+                asst::Log.error("AdbClient set non-blocking failed");
+                return false;
+            }
+            if (::connect(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 &&
+                (!connect_in_progress() || !wait_connected())) {
+                // server 没有启动是正常情况，由调用者回退到 adb 进程
+                asst::Log.trace("AdbClient connect to", host, port, "failed");
+                return false;
+            }
+            return set_nonblocking(m_socket, false);
+        }
+
+        // 请求格式为 4 位十六进制长度 + 服务名
+        bool send_request(std::string_view service)
+        {
+            char len_buf[5] = { 0 };
+            std::snprintf(len_buf, sizeof(len_buf), "%04zx", service.size());
+            std::string request = std::string(len_buf, 4) + std::string(service);
+            return send_all(request.data(), request.size());
+        }
+
+        // 回复为 OKAY，或者 FAIL + 4 位十六进制长度 + 错误信息
+        bool read_status(std::string_view service)
+        {
+            char status[4] = { 0 };
+            if (!recv_exact(status, sizeof(status))) {
+                asst::Log.error("AdbClient read status of", service, "failed");
+                return false;
+            }
+            std::string_view status_view(status, sizeof(status));
+            if (status_view == "OKAY") {
+                return true;
+            }
+            if (status_view == "FAIL") {
+                asst::Log.warn("AdbClient", service, "failed:", read_payload().value_or(std::string()));
+            }
+            else {
+                asst::Log.error("AdbClient", service, "unknown status:", status_view);
+            }
+            return false;
+        }
+
+        // 4 位十六进制长度 + 内容；有的服务（例如 host:kill）回复 OKAY 后直接关闭连接，此时返回空字符串
+        std::optional<std::string> read_payload()
+        {
+            char len_buf[5] = { 0 };
+            int64_t first = recv_some(len_buf, 4);
+            if (first == 0) {
+                return std::string();
+            }
+            if (first < 0 || (first < 4 && !recv_exact(len_buf + first, static_cast<size_t>(4 - first)))) {
+                return std::nullopt;
+            }
+            size_t len = std::strtoul(len_buf, nullptr, 16);
+            std::string payload(len, '\0');
+            if (len != 0 && !recv_exact(payload.data(), len)) {
+                return std::nullopt;
+            }
+            return payload;
+        }
+
+        // 直接读到目标 string 的内存中，不经过额外的缓冲区
+        bool read_until_eof(std::string& data)
+        {
+            constexpr size_t MinChunkSize = 64 * 1024;
+            while (true) {
+                size_t cur_size = data.size();
+                size_t chunk = (std::max)(MinChunkSize, cur_size);
+                data.resize(cur_size + chunk);
+                int64_t read_num = recv_some(data.data() + cur_size, chunk);
+                data.resize(cur_size + static_cast<size_t>((std::max)(read_num, int64_t(0))));
+                if (read_num == 0) {
+                    return true;
+                }
+                if (read_num < 0) {
+                    return false;
+                }
+            }
+        }
+
+        // shell,v2 协议：每个包为 id(u8) + 长度(u32, 小端序) + 内容，stdout、stderr 的内容交给 on_output，
+        // 返回 exit 包中的退出码。没收到 exit 包连接就断开了时返回 nullopt
+        std::optional<int> read_shell_v2(const asst::AdbClient::OutputSink& on_output)
+        {
+            enum PacketId : uint8_t
+            {
+                Stdout = 1,
+                Stderr = 2,
+                Exit = 3,
+            };
+            std::string payload;
+            while (true) {
+                unsigned char header[5] = { 0 };
+                if (!recv_exact(reinterpret_cast<char*>(header), sizeof(header))) {
+                    asst::Log.error("AdbClient shell,v2 closed without exit code");
+                    return std::nullopt;
+                }
+                uint32_t len = static_cast<uint32_t>(header[1]) | (static_cast<uint32_t>(header[2]) << 8) |
+                               (static_cast<uint32_t>(header[3]) << 16) | (static_cast<uint32_t>(header[4]) << 24);
+                payload.resize(len);
+                if (len != 0 && !recv_exact(payload.data(), len)) {
+                    return std::nullopt;
+                }
+                switch (header[0]) {
+                case Stdout:
+                case Stderr:
+                    on_output(payload);
+                    break;
+                case Exit:
+                    return payload.empty() ? 0 : static_cast<unsigned char>(payload.front());
+                default:
+                    // 窗口大小之类的包与非交互的命令无关，忽略
+                    break;
+                }
+            }
+        }
+
+        // 每收到一段数据就交给 on_output，不保存
+        bool read_until_eof(const asst::AdbClient::OutputSink& on_output)
+        {
+            constexpr size_t ChunkSize = 64 * 1024;
+            auto buffer = std::make_unique<char[]>(ChunkSize);
+            while (true) {
+                int64_t read_num = recv_some(buffer.get(), ChunkSize);
+                if (read_num == 0) {
+                    return true;
+                }
+                if (read_num < 0) {
+                    return false;
+                }
+                on_output(std::string_view(buffer.get(), static_cast<size_t>(read_num)));
+            }
+        }
+
+        bool send_all(const char* data, size_t len)
+        {
+            while (len > 0) {
+                auto sent = ::send(m_socket, data, static_cast<int>(len), SendFlags);
+                if (sent <= 0) {
+                    asst::Log.error("AdbClient send failed");
+                    return false;
+                }
+                data += sent;
+                len -= static_cast<size_t>(sent);
+            }
+            return true;
+        }
+
+        bool recv_exact(char* buf, size_t len)
+        {
+            while (len > 0) {
+                int64_t read_num = recv_some(buf, len);
+                if (read_num <= 0) {
+                    return false;
+                }
+                buf += read_num;
+                len -= static_cast<size_t>(read_num);
+            }
+            return true;
+        }
+
+        AdbSocket& operator=(const AdbSocket&) = delete;
+        AdbSocket& operator=(AdbSocket&&) = delete;
+
+    private:
+        int remaining_ms() const
+        {
+            using namespace std::chrono;
+            auto remaining = duration_cast<milliseconds>(m_deadline - steady_clock::now()).count();
+            return static_cast<int>((std::max)(remaining, decltype(remaining)(0)));
+        }
+
+        // 等待非阻塞的 connect 完成，超时或者连接被拒绝时返回 false
+        bool wait_connected()
+        {
+            while (true) {
+                int timeout = remaining_ms();
+                if (timeout <= 0) {
+                    asst::Log.warn("AdbClient connect timeout");
+                    return false;
+                }
+                pollfd pfd {};
+                pfd.fd = m_socket;
+                pfd.events = POLLOUT;
+                int poll_ret = poll_socket(&pfd, 1, timeout);
+                if (poll_ret == 0) {
+                    continue;
+                }
+                if (poll_ret < 0) {
+#ifndef _WIN32
+                    if (errno == EINTR) {
+                        continue;
+                    }
+#endif
+                    return false;
+                }
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (::getsockopt(m_socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &len) != 0) {
+                    return false;
+                }
+                return error == 0;
+            }
+        }
+
+        // 返回读到的字节数，0 表示对端关闭，-1 表示出错或超时
+        int64_t recv_some(char* buf, size_t len)
+        {
+            while (true) {
+                int timeout = remaining_ms();
+                if (timeout <= 0) {
+                    asst::Log.warn("AdbClient recv timeout");
+                    return -1;
+                }
+                pollfd pfd {};
+                pfd.fd = m_socket;
+                pfd.events = POLLIN;
+                int poll_ret = poll_socket(&pfd, 1, timeout);
+                if (poll_ret == 0) {
+                    continue;
+                }
+                if (poll_ret < 0) {
+#ifndef _WIN32
+                    if (errno == EINTR) {
+                        continue;
+                    }
+#endif
+                    asst::Log.error("AdbClient poll failed");
+                    return -1;
+                }
+                auto read_num = ::recv(m_socket, buf, static_cast<int>(len), 0);
+                return read_num < 0 ? -1 : static_cast<int64_t>(read_num);
+            }
+        }
+
+        socket_t m_socket = InvalidSocket;
+        std::chrono::steady_clock::time_point m_deadline;
+    };
+}
+
+struct asst::AdbStream::Impl
+{
+    explicit Impl(int64_t timeout) : sock(timeout) {}
+    AdbSocket sock;
+};
+
+asst::AdbStream::AdbStream(std::unique_ptr<Impl> impl) : m_impl(std::move(impl)) {}
+
+asst::AdbStream::~AdbStream() = default;
+
+bool asst::AdbStream::write(std::string_view data, int64_t timeout)
+{
+    m_impl->sock.set_timeout(timeout);
+    return m_impl->sock.send_all(data.data(), data.size());
+}
+
+bool asst::AdbStream::read_exact(char* buf, size_t len, int64_t timeout)
+{
+    m_impl->sock.set_timeout(timeout);
+    return m_impl->sock.recv_exact(buf, len);
+}
+
+asst::AdbClient::AdbClient(std::string host, unsigned short port) : m_host(std::move(host)), m_port(port)
+{
+#ifdef _WIN32
+    WSADATA wsa_data {};
+    m_supports = ::WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+    if (!m_supports) {
+        Log.error("AdbClient WSAStartup failed");
+    }
+#else
+    m_supports = true;
+#endif
+}
+
+asst::AdbClient::~AdbClient()
+{
+#ifdef _WIN32
+    if (m_supports) {
+        ::WSACleanup();
+    }
+#endif
+}
+
+unsigned short asst::AdbClient::default_port()
+{
+    // MSVC 下 std::getenv 会报 C4996，所以 Windows 用 _dupenv_s
+    std::string port_str;
+#ifdef _WIN32
+    char* env = nullptr;
+    size_t env_len = 0;
+    if (_dupenv_s(&env, &env_len, "ANDROID_ADB_SERVER_PORT") == 0 && env) {
+        port_str = env;
+        free(env);
+    }
+#else
+    if (const char* env = std::getenv("ANDROID_ADB_SERVER_PORT")) {
+        port_str = env;
+    }
+#endif
+    if (port_str.empty()) {
+        return DefaultPort;
+    }
+    unsigned long port = std::strtoul(port_str.c_str(), nullptr, 10);
+    if (port == 0 || port > 65535) {
+        return DefaultPort;
+    }
+    return static_cast<unsigned short>(port);
+}
+
+bool asst::AdbClient::available(int64_t timeout) const
+{
+    return host_request("host:version", timeout).has_value();
+}
+
+std::optional<std::string> asst::AdbClient::host_request(const std::string& service, int64_t timeout) const
+{
+    if (!m_supports) {
+        return std::nullopt;
+    }
+
+    AdbSocket sock(timeout);
+    if (!sock.connect(m_host, m_port) || !sock.send_request(service) || !sock.read_status(service)) {
+        return std::nullopt;
+    }
+    return sock.read_payload();
+}
+
+std::optional<std::string> asst::AdbClient::transport_request(const std::string& serial, const std::string& service,
+                                                              int64_t timeout, const OutputSink& on_output) const
+{
+    if (!m_supports) {
+        return std::nullopt;
+    }
+
+    AdbSocket sock(timeout);
+    if (!sock.connect(m_host, m_port)) {
+        return std::nullopt;
+    }
+    std::string transport = "host:transport:" + serial;
+    if (!sock.send_request(transport) || !sock.read_status(transport)) {
+        return std::nullopt;
+    }
+    if (!sock.send_request(service) || !sock.read_status(service)) {
+        return std::nullopt;
+    }
+
+    std::string data;
+    if (on_output ? !sock.read_until_eof(on_output) : !sock.read_until_eof(data)) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+std::optional<asst::AdbClient::ShellResult> asst::AdbClient::shell(const std::string& serial,
+                                                                  const std::string& command, int64_t timeout,
+                                                                  const OutputSink& on_output) const
+{
+    if (!m_supports) {
+        return std::nullopt;
+    }
+    if (!has_feature(serial, "shell_v2", timeout)) {
+        auto output = transport_request(serial, "shell:" + command, timeout, on_output);
+        if (!output) {
+            return std::nullopt;
+        }
+        return ShellResult { std::move(output).value(), std::nullopt };
+    }
+
+    AdbSocket sock(timeout);
+    if (!sock.connect(m_host, m_port)) {
+        return std::nullopt;
+    }
+    std::string transport = "host:transport:" + serial;
+    if (!sock.send_request(transport) || !sock.read_status(transport)) {
+        return std::nullopt;
+    }
+    // raw 表示不分配 pty，与 adb 进程执行非交互的命令时一样，输出不会被转换成 CRLF
+    std::string service = "shell,v2,raw:" + command;
+    if (!sock.send_request(service) || !sock.read_status(service)) {
+        return std::nullopt;
+    }
+    // 不需要输入，直接关闭 stdin（close stdin 包，id 为 4，长度为 0），免得读 stdin 的命令一直等着
+    static constexpr char CloseStdin[5] = { 4, 0, 0, 0, 0 };
+    if (!sock.send_all(CloseStdin, sizeof(CloseStdin))) {
+        return std::nullopt;
+    }
+
+    ShellResult result;
+    std::optional<int> exit_code;
+    if (on_output) {
+        exit_code = sock.read_shell_v2(on_output);
+    }
+    else {
+        exit_code = sock.read_shell_v2([&](std::string_view chunk) { result.output.append(chunk); });
+    }
+    if (!exit_code) {
+        return std::nullopt;
+    }
+    result.exit_code = exit_code;
+    return result;
+}
+
+bool asst::AdbClient::has_feature(const std::string& serial, std::string_view feature, int64_t timeout) const
+{
+    std::string features;
+    {
+        std::unique_lock<std::mutex> lock(m_features_mutex);
+        if (auto iter = m_features.find(serial); iter != m_features.cend()) {
+            features = iter->second;
+        }
+        else {
+            lock.unlock();
+            auto ret = host_request("host-serial:" + serial + ":features", timeout);
+            if (!ret) {
+                return false;
+            }
+            Log.info("AdbClient features of", serial, ":", ret.value());
+            features = std::move(ret).value();
+            lock.lock();
+            m_features.insert_or_assign(serial, features);
+        }
+    }
+    // 以逗号分隔
+    std::string_view rest = features;
+    while (!rest.empty()) {
+        size_t pos = rest.find(',');
+        if (rest.substr(0, pos) == feature) {
+            return true;
+        }
+        if (pos == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(pos + 1);
+    }
+    return false;
+}
+
+std::unique_ptr<asst::AdbStream> asst::AdbClient::open_transport(const std::string& serial,
+                                                                 const std::string& service, int64_t timeout) const
+{
+    if (!m_supports) {
+        return nullptr;
+    }
+
+    auto impl = std::make_unique<AdbStream::Impl>(timeout);
+    AdbSocket& sock = impl->sock;
+    if (!sock.connect(m_host, m_port)) {
+        return nullptr;
+    }
+    std::string transport = "host:transport:" + serial;
+    if (!sock.send_request(transport) || !sock.read_status(transport)) {
+        return nullptr;
+    }
+    if (!sock.send_request(service) || !sock.read_status(service)) {
+        return nullptr;
+    }
+    return std::make_unique<AdbStream>(std::move(impl));
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace asst
+{
+    // 保持连接的服务，可以反复读写，例如让设备上的进程按请求持续输出截图
+    // 只能在创建它的 AdbClient 析构之前使用
+    class AdbStream
+    {
+    public:
+        struct Impl;
+        explicit AdbStream(std::unique_ptr<Impl> impl);
+        AdbStream(const AdbStream&) = delete;
+        AdbStream(AdbStream&&) = delete;
+        ~AdbStream();
+
+        bool write(std::string_view data, int64_t timeout);
+        // 读满 len 字节，超时或者连接断开时返回 false，此时流中的数据已经错位，不应该再继续使用
+        bool read_exact(char* buf, size_t len, int64_t timeout);
+
+        AdbStream& operator=(const AdbStream&) = delete;
+        AdbStream& operator=(AdbStream&&) = delete;
+
+    private:
+        std::unique_ptr<Impl> m_impl;
+    };
+
+    // 直接通过 smart socket 协议与 adb server 通信，省去每次启动 adb 进程、再通过管道读取输出的开销
+    // 协议说明见 https://android.googlesource.com/platform/packages/modules/adb/+/HEAD/SERVICES.TXT
+    class AdbClient
+    {
+    public:
+        static constexpr unsigned short DefaultPort = 5037;
+        static constexpr int64_t DefaultTimeout = 20000;
+
+        AdbClient(std::string host = "127.0.0.1", unsigned short port = default_port());
+        AdbClient(const AdbClient&) = delete;
+        AdbClient(AdbClient&&) = delete;
+        ~AdbClient();
+
+        // 与 adb 命令行工具一致，可以通过环境变量 ANDROID_ADB_SERVER_PORT 修改 server 端口
+        static unsigned short default_port();
+
+        // 能否连上 server（host:version）
+        bool available(int64_t timeout = DefaultTimeout) const;
+
+        // host:xxx 系列服务，例如 host:connect:127.0.0.1:5555、host:kill，返回 server 的回复
+        std::optional<std::string> host_request(const std::string& service, int64_t timeout = DefaultTimeout) const;
+
+        using OutputSink = std::function<void(std::string_view)>;
+
+        // 先 host:transport:<serial> 选择设备，再执行 shell:xxx、exec:xxx 等服务，读取全部输出直到设备端关闭连接
+        // 传入 on_output 时，输出每收到一段就交给它处理，不再保存，返回空字符串
+        std::optional<std::string> transport_request(const std::string& serial, const std::string& service,
+                                                     int64_t timeout = DefaultTimeout,
+                                                     const OutputSink& on_output = nullptr) const;
+
+        struct ShellResult
+        {
+            std::string output;           // stdout 和 stderr 合在一起，与 adb 进程一致；传入 on_output 时为空
+            std::optional<int> exit_code; // 设备不支持 shell_v2 时拿不到退出码
+        };
+        // 在设备上执行 shell 命令。设备支持 shell_v2 时使用 shell,v2,raw: 服务，可以拿到命令的退出码；
+        // 否则使用 shell:，与 adb 进程在这种设备上的行为一样，拿不到退出码
+        std::optional<ShellResult> shell(const std::string& serial, const std::string& command,
+                                         int64_t timeout = DefaultTimeout,
+                                         const OutputSink& on_output = nullptr) const;
+
+        // host-serial:<serial>:features 中是否有 feature，按 serial 缓存，查询失败时返回 false 且不缓存
+        bool has_feature(const std::string& serial, std::string_view feature, int64_t timeout = DefaultTimeout) const;
+
+        // 同 transport_request，但是不等待服务结束，而是返回连接，由调用者继续读写
+        std::unique_ptr<AdbStream> open_transport(const std::string& serial, const std::string& service,
+                                                  int64_t timeout = DefaultTimeout) const;
+
+        const std::string& host() const noexcept { return m_host; }
+        unsigned short port() const noexcept { return m_port; }
+
+        AdbClient& operator=(const AdbClient&) = delete;
+        AdbClient& operator=(AdbClient&&) = delete;
+
+    private:
+        std::string m_host;
+        unsigned short m_port = DefaultPort;
+        bool m_supports = false;
+
+        mutable std::mutex m_features_mutex;
+        mutable std::unordered_map<std::string, std::string> m_features; // serial -> features
+    };
+}
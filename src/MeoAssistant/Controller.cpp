@@ -1,12 +1,19 @@
 #include "Controller.h"
+#include "AdbClient.h"
+#include "ReplaySession.h"
+#include "SessionRecorder.h"
 #include "Utils/AsstConf.h"
+#include "Utils/GzipInflater.h"
 #include "Utils/Platform/AsstPlatform.h"
 
 #ifdef _WIN32
 #include "Utils/Platform/AsstPlatformWin32.h"
 #include <ws2tcpip.h>
 #else
-#include <fcntl.h>
+#include "Utils/Platform/AsstPlatformPosix.h"
+#include <csignal>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #endif
@@ -14,6 +21,7 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -31,8 +39,11 @@
 
 #include "Resource/GeneralConfiger.h"
 #include "Utils/AsstTypes.h"
+#include "Utils/ImageSignature.hpp"
 #include "Utils/Logger.hpp"
 #include "Utils/StringMisc.hpp"
+#include "Utils/Time.hpp"
+#include "Utils/UserDir.hpp"
 
 asst::Controller::Controller(AsstCallback callback, void* callback_arg)
     : m_callback(std::move(callback)), m_callback_arg(callback_arg), m_rand_engine(std::random_device {}())
@@ -47,17 +58,15 @@ asst::Controller::Controller(AsstCallback callback, void* callback_arg)
     }
 
 #else
-    int pipe_in_ret = pipe(m_pipe_in);
-    int pipe_out_ret = pipe(m_pipe_out);
-    fcntl(m_pipe_out[PIPE_READ], F_SETFL, O_NONBLOCK);
-
-    if (pipe_in_ret < 0 || pipe_out_ret < 0) {
-        Log.error(__FUNCTION__, "controller pipe created failed", pipe_in_ret, pipe_out_ret);
+    // 子进程的输出管道每次调用时单独创建，读到 EOF 就说明子进程已经退出，不需要轮询
+    if (!posix::create_pipe_cloexec(m_pipe_in)) {
+        Log.error(__FUNCTION__, "controller pipe created failed");
     }
     m_support_socket = false;
 #endif
 
     m_cmd_thread = std::thread(&Controller::pipe_working_proc, this);
+    m_screencap_thread = std::thread(&Controller::screencap_working_proc, this);
 }
 
 asst::Controller::~Controller()
@@ -68,19 +77,25 @@ asst::Controller::~Controller()
     // m_thread_idle = true;
     m_cmd_condvar.notify_all();
     m_completed_id = UINT_MAX; // make all WinMacor::wait to exit
+    {
+        std::unique_lock<std::mutex> frame_lock(m_frame_mutex);
+        m_frame_condvar.notify_all();
+    }
 
     if (m_cmd_thread.joinable()) {
         m_cmd_thread.join();
     }
+    if (m_screencap_thread.joinable()) {
+        m_screencap_thread.join();
+    }
 
+    close_shell();
     set_inited(false);
     kill_adb_daemon();
 
 #ifndef _WIN32
     close(m_pipe_in[PIPE_READ]);
     close(m_pipe_in[PIPE_WRITE]);
-    close(m_pipe_out[PIPE_READ]);
-    close(m_pipe_out[PIPE_WRITE]);
 #endif
 }
 
@@ -151,16 +166,33 @@ void asst::Controller::pipe_working_proc()
 {
     LogTraceFunction;
 
+#ifndef _WIN32
+    // shell 意外退出时，向其 stdin 写入会触发 SIGPIPE，这里只在本线程屏蔽，改为通过 EPIPE 处理
+    sigset_t sigpipe_set;
+    sigemptyset(&sigpipe_set);
+    sigaddset(&sigpipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe_set, nullptr);
+#endif
+
     while (!m_thread_exit) {
         std::unique_lock<std::mutex> cmd_queue_lock(m_cmd_queue_mutex);
 
         if (!m_cmd_queue.empty()) { // 队列中有任务就执行任务
-            std::string cmd = m_cmd_queue.front();
+            CmdItem item = std::move(m_cmd_queue.front());
             m_cmd_queue.pop();
             cmd_queue_lock.unlock();
             // todo 判断命令是否执行成功
-            call_command(cmd);
+            if (m_replay) {
+                m_replay->on_action(item.action);
+            }
+            else if (item.shell_cmd.empty() || !call_shell(item.shell_cmd).sent) {
+                // 只有命令没能写入 shell 时才回退，已经发出去的命令即使超时或失败也不再执行一遍
+                call_command(item.cmd);
+            }
             ++m_completed_id;
+            // 操作执行完了，之前因为有操作未完成而等待的预截图可以开始了
+            std::unique_lock<std::mutex> frame_lock(m_frame_mutex);
+            m_frame_condvar.notify_all();
         }
         // else if (!m_thread_idle) {	// 队列中没有任务，又不是闲置的时候，就去截图
         //	cmd_queue_lock.unlock();
@@ -181,22 +213,69 @@ void asst::Controller::pipe_working_proc()
     }
 }
 
+void asst::Controller::screencap_working_proc()
+{
+    LogTraceFunction;
+
+    while (!m_thread_exit) {
+        std::unique_lock<std::mutex> frame_lock(m_frame_mutex);
+        // 还有操作没执行完的时候截到的图，对调用者来说一定是过时的，等操作都执行完再截
+        m_frame_condvar.wait(frame_lock, [&]() -> bool {
+            return m_thread_exit || (m_frame_prefetch && m_completed_id >= last_action_id());
+        });
+        if (m_thread_exit) {
+            break;
+        }
+        m_frame_prefetch = false;
+        frame_lock.unlock();
+
+        std::unique_lock<std::mutex> screencap_lock(m_screencap_mutex);
+        if (!inited() || need_exit() || m_adb.screencap_method == AdbProperty::ScreencapMethod::UnknownYet) {
+            continue;
+        }
+        // 失败了也不重试，交给调用者在 get_image 中重试或重连
+        screencap_frame(false, true);
+    }
+}
+
 std::optional<std::string> asst::Controller::call_command(const std::string& cmd, int64_t timeout, bool allow_reconnect,
-                                                          bool recv_by_socket)
+                                                          bool recv_by_socket, const OutputSink& on_stdout)
 {
     using namespace std::chrono_literals;
     using namespace std::chrono;
     // LogTraceScope(std::string(__FUNCTION__) + " | `" + cmd + "`");
 
+    size_t streamed_size = 0;
+    OutputSink stdout_sink = nullptr;
+    if (on_stdout) {
+        stdout_sink = [&](std::string_view chunk) {
+            streamed_size += chunk.size();
+            on_stdout(chunk);
+        };
+    }
+
+    if (!recv_by_socket) {
+        auto native_ret = call_command_by_native(cmd, timeout, stdout_sink);
+        if (native_ret.handled) {
+            // 设备上的命令执行失败（退出码非 0）时 output 为空，和 adb 进程返回非 0 一样视为失败，
+            // 但设备是连着的，不需要重连，也不能再执行一遍
+            return std::move(native_ret.output);
+        }
+        // 已经有一部分输出交给 on_stdout 处理了，不能再启动 adb 进程把输出从头再来一遍
+        if (streamed_size != 0) {
+            return std::nullopt;
+        }
+    }
+
     std::string pipe_data;
     std::string sock_data;
-    asst::platform::single_page_buffer<char> pipe_buffer;
     std::optional<asst::platform::single_page_buffer<char>> sock_buffer;
 
     auto start_time = steady_clock::now();
     std::unique_lock<std::mutex> callcmd_lock(m_callcmd_mutex);
 
 #ifdef _WIN32
+    asst::platform::single_page_buffer<char> pipe_buffer;
 
     DWORD err = 0;
     HANDLE pipe_parent_read = INVALID_HANDLE_VALUE, pipe_child_write = INVALID_HANDLE_VALUE;
@@ -324,7 +403,12 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
             // pipe read
             DWORD len = 0;
             if (GetOverlappedResult(pipe_parent_read, &pipeov, &len, FALSE)) {
-                pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + len);
+                if (stdout_sink) {
+                    stdout_sink(std::string_view(pipe_buffer.get(), len));
+                }
+                else {
+                    pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + len);
+                }
                 (void)ReadFile(pipe_parent_read, pipe_buffer.get(), (DWORD)pipe_buffer.size(), nullptr, &pipeov);
             }
             else {
@@ -394,42 +478,30 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     }
 
 #else
-    auto check_timeout = [&]() -> bool {
-        return timeout && timeout < duration_cast<milliseconds>(steady_clock::now() - start_time).count();
-    };
+    int pipe_out[2] = { 0 };
+    if (!posix::create_pipe_cloexec(pipe_out)) {
+        Log.error("Call `", cmd, "` create pipe failed");
+        return std::nullopt;
+    }
 
     int exit_ret = 0;
-    m_child = fork();
-    if (m_child == 0) {
-        // child process
-
-        dup2(m_pipe_in[PIPE_READ], STDIN_FILENO);
-        dup2(m_pipe_out[PIPE_WRITE], STDOUT_FILENO);
-        dup2(m_pipe_out[PIPE_WRITE], STDERR_FILENO);
-
-        // all these are for use by parent only
-        // close(m_pipe_in[PIPE_READ]);
-        // close(m_pipe_in[PIPE_WRITE]);
-        // close(m_pipe_out[PIPE_READ]);
-        // close(m_pipe_out[PIPE_WRITE]);
-
-        exit_ret = execlp("sh", "sh", "-c", cmd.c_str(), nullptr);
-        exit(exit_ret);
-    }
-    else if (m_child > 0) {
-        // parent process
-        do {
-            ssize_t read_num = read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
-
-            while (read_num > 0) {
-                pipe_data.insert(pipe_data.end(), pipe_buffer.get(), pipe_buffer.get() + read_num);
-                read_num = read(m_pipe_out[PIPE_READ], pipe_buffer.get(), pipe_buffer.size());
-            }
-        } while (::waitpid(m_child, &exit_ret, WNOHANG) == 0 && !check_timeout());
+    m_child = posix::spawn_shell(cmd, m_pipe_in[PIPE_READ], pipe_out[PIPE_WRITE], pipe_out[PIPE_WRITE]);
+    close(pipe_out[PIPE_WRITE]);
+    if (m_child > 0) {
+        // 阻塞在 poll 上等待输出，超时或者需要退出时会杀掉子进程
+        auto interrupt = [&]() -> bool { return need_exit(); };
+        if (stdout_sink) {
+            exit_ret = posix::wait_child_output(m_child, pipe_out[PIPE_READ], stdout_sink, timeout, interrupt);
+        }
+        else {
+            exit_ret = posix::wait_child_output(m_child, pipe_out[PIPE_READ], pipe_data, timeout, interrupt);
+        }
+        close(pipe_out[PIPE_READ]);
     }
     else {
         // failed to create child process
         Log.error("Call `", cmd, "` create process failed, child:", m_child);
+        close(pipe_out[PIPE_READ]);
         return std::nullopt;
     }
 #endif
@@ -437,8 +509,8 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     callcmd_lock.unlock();
 
     auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
-    Log.info("Call `", cmd, "` ret", exit_ret, ", cost", duration, "ms , stdout size:", pipe_data.size(),
-             ", socket size:", sock_data.size());
+    Log.info("Call `", cmd, "` ret", exit_ret, ", cost", duration, "ms , stdout size:",
+             pipe_data.size() + streamed_size, ", socket size:", sock_data.size());
     if (!pipe_data.empty() && pipe_data.size() < 4096) {
         Log.trace("stdout output:", Logger::separator::newline, pipe_data);
     }
@@ -514,6 +586,117 @@ std::optional<std::string> asst::Controller::call_command(const std::string& cmd
     return std::nullopt;
 }
 
+asst::Controller::NativeCallResult asst::Controller::call_command_by_native(const std::string& cmd,
+                                                                           int64_t timeout,
+                                                                           const OutputSink& on_stdout)
+{
+    if (!m_adb_client) {
+        return {};
+    }
+
+    using namespace std::chrono;
+    auto start_time = steady_clock::now();
+
+    // adb 命令行会把 shell / exec-out 之后的参数用空格拼起来交给设备，这里只需要去掉一层命令行引号
+    auto join_args = [](std::string_view args) -> std::string {
+        std::string result;
+        result.reserve(args.size());
+        size_t backslashes = 0;
+        for (char ch : args) {
+            if (ch == '\\') {
+                ++backslashes;
+                continue;
+            }
+            if (ch == '"') {
+                result.append(backslashes / 2, '\\');
+                if (backslashes % 2) {
+                    result.push_back('"');
+                }
+            }
+            else {
+                result.append(backslashes, '\\');
+                result.push_back(ch);
+            }
+            backslashes = 0;
+        }
+        result.append(backslashes, '\\');
+        return result;
+    };
+    // adb 进程是通过 sh -c 启动的：引号外的管道、重定向、通配符等，以及引号内的 $ 和 `，都由本机的 shell 处理，
+    // 整条交给设备的 shell 会改变命令的含义，这类命令仍然交给 adb 进程执行
+    auto need_host_shell = [](std::string_view args) -> bool {
+        static constexpr std::string_view Unquoted = "|&;<>()$`'\\*?[]{}~#";
+        static constexpr std::string_view Quoted = "$`\\";
+        bool quoted = false;
+        for (char ch : args) {
+            if (ch == '"') {
+                quoted = !quoted;
+            }
+            else if ((quoted ? Quoted : Unquoted).find(ch) != std::string_view::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::optional<std::string> ret;
+    const std::string transport_prefix = m_adb_path + " -s " + m_adb_serial + " ";
+    if (cmd.starts_with(transport_prefix)) {
+        static constexpr std::string_view ShellArg = "shell ";
+        static constexpr std::string_view ExecOutArg = "exec-out ";
+        std::string_view args = std::string_view(cmd).substr(transport_prefix.size());
+        if (need_host_shell(args)) {
+            return {};
+        }
+        if (args.starts_with(ShellArg)) {
+            auto shell_ret =
+                m_adb_client->shell(m_adb_serial, join_args(args.substr(ShellArg.size())), timeout, on_stdout);
+            if (shell_ret && shell_ret->exit_code.value_or(0) != 0) {
+                // 设备上的命令已经执行并且失败了，这是命令本身的结果，不能再交给 adb 进程执行一遍
+                auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+                Log.info("Call `", cmd, "` by native adb ret", shell_ret->exit_code.value(), ", cost", duration,
+                         "ms");
+                return { .handled = true, .output = std::nullopt };
+            }
+            if (shell_ret) {
+                ret = std::move(shell_ret->output);
+            }
+        }
+        else if (args.starts_with(ExecOutArg)) {
+            ret = m_adb_client->transport_request(m_adb_serial, "exec:" + join_args(args.substr(ExecOutArg.size())),
+                                                  timeout, on_stdout);
+        }
+        else {
+            return {};
+        }
+    }
+    else if (cmd == m_adb_path + " connect " + m_adb_serial) {
+        ret = m_adb_client->host_request("host:connect:" + m_adb_serial, timeout);
+        // 连不上时交给 adb 进程再试一次，保持原有的错误信息和重试逻辑
+        if (ret && ret->find("connected to") == std::string::npos) {
+            Log.info("Native adb connect failed:", ret.value());
+            ret = std::nullopt;
+        }
+    }
+    else if (cmd == m_adb_path + " kill-server") {
+        ret = m_adb_client->host_request("host:kill", timeout);
+    }
+    else {
+        return {};
+    }
+
+    auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    if (!ret) {
+        Log.info("Call `", cmd, "` by native adb failed, cost", duration, "ms, fallback to adb process");
+        return {};
+    }
+    Log.info("Call `", cmd, "` by native adb, cost", duration, "ms , stdout size:", ret->size());
+    if (!ret->empty() && ret->size() < 4096) {
+        Log.trace("stdout output:", Logger::separator::newline, ret.value());
+    }
+    return { .handled = true, .output = std::move(ret) };
+}
+
 void asst::Controller::callback(AsstMsg msg, const json::value& details)
 {
     if (m_callback) {
@@ -596,8 +779,20 @@ void asst::Controller::random_delay() const
 
 void asst::Controller::clear_info() noexcept
 {
+    close_shell();
     set_inited(false);
     m_adb = decltype(m_adb)();
+    m_screencap_stream = nullptr;
+    m_screencap_header_size = 0;
+    m_replay = nullptr;
+    stop_recording();
+    {
+        std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+        m_screencap_stats = decltype(m_screencap_stats)();
+    }
+    m_adb_client = nullptr;
+    m_adb_path.clear();
+    m_adb_serial.clear();
     m_uuid.clear();
     m_width = 0;
     m_height = 0;
@@ -605,14 +800,319 @@ void asst::Controller::clear_info() noexcept
     m_scale_size = { WindowWidthDefault, WindowHeightDefault };
 }
 
-int asst::Controller::push_cmd(const std::string& cmd)
+int asst::Controller::push_cmd(std::string action, const std::string& cmd, const std::string& shell_cmd)
 {
     random_delay();
 
+    auto cur_recorder = recorder();
     std::unique_lock<std::mutex> lock(m_cmd_queue_mutex);
-    m_cmd_queue.emplace(cmd);
+    unsigned id = ++m_push_id;
+    if (cur_recorder) {
+        cur_recorder->add_action(id, action);
+    }
+    m_cmd_queue.emplace(CmdItem { cmd, shell_cmd, std::move(action) });
     m_cmd_condvar.notify_one();
-    return static_cast<int>(++m_push_id);
+    return static_cast<int>(id);
+}
+
+std::shared_ptr<asst::SessionRecorder> asst::Controller::recorder()
+{
+    std::unique_lock<std::mutex> lock(m_recorder_mutex);
+    return m_recorder;
+}
+
+bool asst::Controller::start_recording(const std::filesystem::path& path)
+{
+    std::shared_ptr<SessionRecorder> new_recorder = SessionRecorder::open(path);
+    if (!new_recorder) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_recorder_mutex);
+    m_recorder = std::move(new_recorder);
+    return true;
+}
+
+void asst::Controller::stop_recording()
+{
+    std::unique_lock<std::mutex> lock(m_recorder_mutex);
+    // 其他线程可能还持有它，最后一个使用者释放时写入索引
+    m_recorder = nullptr;
+}
+
+unsigned asst::Controller::last_action_id()
+{
+    std::unique_lock<std::mutex> lock(m_cmd_queue_mutex);
+    return m_push_id;
+}
+
+bool asst::Controller::open_shell()
+{
+    LogTraceFunction;
+
+    if (m_adb.shell.empty()) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> shell_lock(m_shell_mutex);
+    if (m_shell_buffer) {
+        return true;
+    }
+
+#ifdef _WIN32
+    DWORD err = 0;
+    SECURITY_ATTRIBUTES sa_inherit { .nLength = sizeof(SECURITY_ATTRIBUTES), .bInheritHandle = TRUE };
+
+    HANDLE pipe_child_read = INVALID_HANDLE_VALUE, pipe_parent_write = INVALID_HANDLE_VALUE;
+    if (!CreatePipe(&pipe_child_read, &pipe_parent_write, &sa_inherit, static_cast<DWORD>(ShellBufferSize))) {
+        err = GetLastError();
+        Log.error("CreatePipe failed, err", err);
+        return false;
+    }
+    // 父进程写入的一端不能被子进程继承，否则 shell 永远收不到 EOF
+    SetHandleInformation(pipe_parent_write, HANDLE_FLAG_INHERIT, 0);
+
+    HANDLE pipe_parent_read = INVALID_HANDLE_VALUE, pipe_child_write = INVALID_HANDLE_VALUE;
+    if (!asst::win32::CreateOverlappablePipe(&pipe_parent_read, &pipe_child_write, nullptr, &sa_inherit,
+                                             static_cast<DWORD>(ShellBufferSize), true, false)) {
+        err = GetLastError();
+        Log.error("CreateOverlappablePipe failed, err", err);
+        CloseHandle(pipe_child_read);
+        CloseHandle(pipe_parent_write);
+        return false;
+    }
+
+    STARTUPINFOW si {};
+    si.cb = sizeof(STARTUPINFOW);
+    si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+    si.wShowWindow = SW_HIDE;
+    si.hStdInput = pipe_child_read;
+    si.hStdOutput = pipe_child_write;
+    si.hStdError = pipe_child_write;
+    ASST_AUTO_DEDUCED_ZERO_INIT_START
+    PROCESS_INFORMATION process_info = { nullptr };
+    ASST_AUTO_DEDUCED_ZERO_INIT_END
+
+    auto cmdline_osstr = asst::utils::to_osstring(m_adb.shell);
+    BOOL create_ret =
+        CreateProcessW(nullptr, &cmdline_osstr[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &process_info);
+    CloseHandle(pipe_child_read);
+    CloseHandle(pipe_child_write);
+    if (!create_ret) {
+        Log.error("Call `", m_adb.shell, "` create process failed, ret", create_ret);
+        CloseHandle(pipe_parent_write);
+        CloseHandle(pipe_parent_read);
+        return false;
+    }
+    CloseHandle(process_info.hThread);
+
+    m_shell_process = process_info.hProcess;
+    m_shell_stdin = pipe_parent_write;
+    m_shell_stdout = pipe_parent_read;
+    m_shell_ov = {};
+    m_shell_ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    m_shell_read_pending = false;
+#else
+    int pipe_in[2] = { 0 };
+    int pipe_out[2] = { 0 };
+    // 父进程持有的两端不能被之后 fork 出来的其他子进程继承，否则 shell 永远收不到 EOF
+    if (!posix::create_pipe_cloexec(pipe_in)) {
+        Log.error("shell pipe created failed");
+        return false;
+    }
+    if (!posix::create_pipe_cloexec(pipe_out)) {
+        Log.error("shell pipe created failed");
+        close(pipe_in[PIPE_READ]);
+        close(pipe_in[PIPE_WRITE]);
+        return false;
+    }
+
+    int child = posix::spawn_shell(m_adb.shell, pipe_in[PIPE_READ], pipe_out[PIPE_WRITE], pipe_out[PIPE_WRITE]);
+
+    // parent process, close unused file descriptors, these are for child only
+    close(pipe_in[PIPE_READ]);
+    close(pipe_out[PIPE_WRITE]);
+    if (child < 0) {
+        Log.error("Call `", m_adb.shell, "` create process failed, child:", child);
+        close(pipe_in[PIPE_WRITE]);
+        close(pipe_out[PIPE_READ]);
+        return false;
+    }
+
+    m_shell_child = child;
+    m_shell_in = pipe_in[PIPE_WRITE];
+    m_shell_out = pipe_out[PIPE_READ];
+#endif
+
+    m_shell_buffer = std::make_unique<char[]>(ShellBufferSize);
+    m_shell_output.clear();
+    Log.info("Shell `", m_adb.shell, "` opened");
+    return true;
+}
+
+void asst::Controller::close_shell() noexcept
+{
+    std::unique_lock<std::mutex> shell_lock(m_shell_mutex);
+    if (!m_shell_buffer) {
+        return;
+    }
+    LogTraceFunction;
+
+    // 先关闭 stdin，正常情况下 shell 读到 EOF 就会自己退出；等不到再强制结束
+    static constexpr int ExitWaitTime = 1000;
+#ifdef _WIN32
+    CloseHandle(m_shell_stdin);
+    if (WaitForSingleObject(m_shell_process, ExitWaitTime) != WAIT_OBJECT_0) {
+        TerminateProcess(m_shell_process, 0);
+    }
+    if (m_shell_read_pending) {
+        DWORD len = 0;
+        CancelIoEx(m_shell_stdout, &m_shell_ov);
+        GetOverlappedResult(m_shell_stdout, &m_shell_ov, &len, TRUE);
+        m_shell_read_pending = false;
+    }
+    CloseHandle(m_shell_stdout);
+    CloseHandle(m_shell_ov.hEvent);
+    CloseHandle(m_shell_process);
+    m_shell_process = nullptr;
+    m_shell_stdin = INVALID_HANDLE_VALUE;
+    m_shell_stdout = INVALID_HANDLE_VALUE;
+    m_shell_ov = {};
+#else
+    using namespace std::chrono;
+    close(m_shell_in);
+    auto start_time = steady_clock::now();
+    while (::waitpid(m_shell_child, nullptr, WNOHANG) == 0) {
+        if (duration_cast<milliseconds>(steady_clock::now() - start_time).count() > ExitWaitTime) {
+            ::kill(m_shell_child, SIGKILL);
+            ::waitpid(m_shell_child, nullptr, 0);
+            break;
+        }
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+    close(m_shell_out);
+    m_shell_child = 0;
+    m_shell_in = -1;
+    m_shell_out = -1;
+#endif
+
+    m_shell_buffer.reset();
+    m_shell_output.clear();
+}
+
+asst::Controller::ShellCallResult asst::Controller::call_shell(const std::string& shell_cmd, int64_t timeout)
+{
+    ShellCallResult ret = call_shell_once(shell_cmd, timeout);
+    if (ret.sent || m_adb.shell.empty() || need_exit()) [[likely]] {
+        return ret;
+    }
+
+    // 命令没有写进去，shell 可能是被 adb 断开了，重新打开一次再试，仍然失败就交给调用者回退到单独的进程
+    Log.warn("Shell is broken, try to reopen it");
+    close_shell();
+    if (!open_shell()) {
+        return ret;
+    }
+    return call_shell_once(shell_cmd, timeout);
+}
+
+asst::Controller::ShellCallResult asst::Controller::call_shell_once(const std::string& shell_cmd, int64_t timeout)
+{
+    using namespace std::chrono;
+
+    ShellCallResult result;
+    std::unique_lock<std::mutex> shell_lock(m_shell_mutex);
+    if (!m_shell_buffer) {
+        return result;
+    }
+
+    auto start_time = steady_clock::now();
+
+    // 每条命令后面追加一个带序号的结束标记（后跟返回值），读到标记即认为该命令执行完毕
+    std::string end_mark = "__MAA_SHELL_END_" + std::to_string(++m_shell_seq) + "__";
+    std::string input = shell_cmd + "; echo " + end_mark + "$?\n";
+
+#ifdef _WIN32
+    DWORD written = 0;
+    if (!WriteFile(m_shell_stdin, input.data(), static_cast<DWORD>(input.size()), &written, nullptr) ||
+        written != input.size()) {
+        Log.error("Write to shell failed, err", GetLastError());
+        return result;
+    }
+#else
+    // shell 可能已经退出（例如设备离线、未授权），调用者不一定是屏蔽了 SIGPIPE 的 pipe_working_proc
+    if (!posix::write_all_no_sigpipe(m_shell_in, input)) {
+        Log.error("Write to shell failed, errno", errno);
+        return result;
+    }
+#endif
+
+    result.sent = true;
+
+    size_t mark_pos = std::string::npos;
+    size_t lf_pos = std::string::npos;
+    auto find_end = [&]() -> bool {
+        mark_pos = m_shell_output.find(end_mark);
+        if (mark_pos == std::string::npos) {
+            return false;
+        }
+        lf_pos = m_shell_output.find('\n', mark_pos + end_mark.size());
+        return lf_pos != std::string::npos;
+    };
+
+    while (!find_end()) {
+        auto remaining = timeout - duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+        if (remaining <= 0) {
+            Log.warn("Shell `", shell_cmd, "` timeout");
+            return result;
+        }
+#ifdef _WIN32
+        if (!m_shell_read_pending) {
+            if (!ReadFile(m_shell_stdout, m_shell_buffer.get(), static_cast<DWORD>(ShellBufferSize), nullptr,
+                          &m_shell_ov) &&
+                GetLastError() != ERROR_IO_PENDING) {
+                Log.error("Read from shell failed, err", GetLastError());
+                return result;
+            }
+            m_shell_read_pending = true;
+        }
+        auto wait_ret = WaitForSingleObject(m_shell_ov.hEvent, static_cast<DWORD>(remaining));
+        if (wait_ret == WAIT_TIMEOUT) {
+            continue;
+        }
+        DWORD len = 0;
+        if (wait_ret != WAIT_OBJECT_0 || !GetOverlappedResult(m_shell_stdout, &m_shell_ov, &len, FALSE)) {
+            Log.error("Read from shell failed, err", GetLastError());
+            m_shell_read_pending = false;
+            return result;
+        }
+        m_shell_read_pending = false;
+        m_shell_output.append(m_shell_buffer.get(), len);
+#else
+        pollfd pfd { .fd = m_shell_out, .events = POLLIN, .revents = 0 };
+        int poll_ret = ::poll(&pfd, 1, static_cast<int>(remaining));
+        if (poll_ret <= 0) {
+            continue;
+        }
+        ssize_t read_num = read(m_shell_out, m_shell_buffer.get(), ShellBufferSize);
+        if (read_num <= 0) {
+            Log.error("Shell is closed, read", read_num);
+            return result;
+        }
+        m_shell_output.append(m_shell_buffer.get(), static_cast<size_t>(read_num));
+#endif
+    }
+
+    result.output = m_shell_output.substr(0, mark_pos);
+    result.exit_code = std::atoi(m_shell_output.c_str() + mark_pos + end_mark.size());
+    m_shell_output.erase(0, lf_pos + 1);
+
+    auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    Log.info("Shell `", shell_cmd, "` ret", *result.exit_code, ", cost", duration,
+             "ms , stdout size:", result.output.size());
+    if (!result.output.empty() && result.output.size() < 4096) {
+        Log.trace("stdout output:", Logger::separator::newline, result.output);
+    }
+    return result;
 }
 
 void asst::Controller::try_to_close_socket() noexcept
@@ -701,7 +1201,19 @@ bool asst::Controller::screencap(bool allow_reconnect)
     //     return true;
     // }
 
-    DecodeFunc decode_raw = [&](std::string_view data) -> bool {
+    if (m_replay) {
+        cv::Mat frame = m_replay->next_frame();
+        if (frame.empty()) {
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+        m_cache_image = frame;
+        ++m_cache_generation;
+        m_cache_payload.clear();
+        return true;
+    }
+
+    DecodeFunc decode_raw = [&](std::string& data) -> bool {
         if (data.empty()) {
             return false;
         }
@@ -710,101 +1222,249 @@ bool asst::Controller::screencap(bool allow_reconnect)
             return false;
         }
         size_t header_size = data.size() - std_size;
-        auto img_data = data.substr(header_size);
-        if (ranges::all_of(img_data, std::logical_not<bool> {})) {
+        auto img_data = std::string_view(data).substr(header_size);
+        if (is_blank_frame(img_data)) {
             return false;
         }
+        m_screencap_header_size = header_size;
+        // 不转换颜色也不拷贝，直接把 RGBA 数据作为缓存，缩放时再转换
         cv::Mat temp(m_height, m_width, CV_8UC4, const_cast<char*>(img_data.data()));
         if (temp.empty()) {
             return false;
         }
-        cv::cvtColor(temp, temp, cv::COLOR_RGB2BGR);
         std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+        m_cache_payload.swap(data);
         m_cache_image = temp;
+        ++m_cache_generation;
+        image_lock.unlock();
+        // 上一帧的内存留着给下次流式解压用
+        if (&data != &m_spare_payload) {
+            m_spare_payload.swap(data);
+        }
         return true;
     };
 
-    DecodeFunc decode_raw_with_gzip = [&](std::string_view data) -> bool {
-        return decode_raw(gzip::decompress(data.data(), data.size()));
+    DecodeFunc decode_raw_with_gzip = [&](std::string& data) -> bool {
+        std::string unzipped = gzip::decompress(data.data(), data.size());
+        return decode_raw(unzipped);
     };
 
-    DecodeFunc decode_encode = [&](std::string_view data) -> bool {
+    DecodeFunc decode_encode = [&](std::string& data) -> bool {
         cv::Mat temp = cv::imdecode({ data.data(), int(data.size()) }, cv::IMREAD_COLOR);
         if (temp.empty()) {
             return false;
         }
         std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
         m_cache_image = temp;
+        ++m_cache_generation;
+        m_cache_payload.clear();
         return true;
     };
 
-    switch (m_adb.screencap_method) {
-    case AdbProperty::ScreencapMethod::UnknownYet: {
-        using namespace std::chrono;
-        Log.info("Try to find the fastest way to screencap");
-        auto min_cost = milliseconds(LLONG_MAX);
-        clear_lf_info();
-
-        auto start_time = high_resolution_clock::now();
-        if (m_support_socket && m_server_started &&
-            screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true)) {
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time);
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::RawByNc;
-                set_inited(true);
-                min_cost = duration;
+    ScreencapFunc screencap_by = [&](ScreencapMethod method) -> bool {
+        switch (method) {
+        case ScreencapMethod::RawByNc:
+            return screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true);
+        case ScreencapMethod::RawWithGzip:
+            // 行尾需要转换时只能先拿到全部数据再处理，没法边收边解压
+            if (m_adb.screencap_end_of_line == AdbProperty::ScreencapEndOfLine::LF &&
+                screencap_raw_with_gzip_stream(decode_raw, decode_raw_with_gzip, allow_reconnect)) {
+                return true;
             }
-            Log.info("RawByNc cost", duration.count(), "ms");
+            return screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect);
+        case ScreencapMethod::Encode:
+            return screencap(m_adb.screencap_encode, decode_encode, allow_reconnect);
+        case ScreencapMethod::RawByStream:
+            return screencap_raw_by_stream(decode_raw);
+        default:
+            return false;
         }
-        else {
-            Log.info("RawByNc is not supported");
+    };
+
+    ScreencapMethod method = m_adb.screencap_method;
+    if (method == ScreencapMethod::UnknownYet) {
+        return select_screencap_method(screencap_by, "Initial");
+    }
+
+    // 模拟器的负载、nc 是否可用等在长时间运行中都会变化，定期重新比较一次各种方式
+    int reprobe_interval = Configer.get_options().screencap_reprobe_interval;
+    if (reprobe_interval > 0 &&
+        std::chrono::steady_clock::now() - m_screencap_selected_time >= std::chrono::seconds(reprobe_interval)) {
+        return select_screencap_method(screencap_by, "Periodic");
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    bool ret = screencap_by(method);
+    auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+    int consecutive_failures = record_screencap_result(method, ret, cost.count());
+
+    static constexpr int MaxConsecutiveFailures = 3;
+    // 全都失败时会保留原来的方式，模拟器重启之类的期间每次截图都重新探测一遍所有方式的话，
+    // 每种方式都要等超时和重连，所以限制一下探测的频率
+    static constexpr auto FallbackProbeInterval = std::chrono::seconds(30);
+    if (consecutive_failures >= MaxConsecutiveFailures &&
+        start_time - m_screencap_fallback_time >= FallbackProbeInterval) {
+        Log.warn(screencap_method_name(method), "failed", consecutive_failures, "times in a row, try other ways");
+        m_screencap_fallback_time = start_time;
+        bool found = select_screencap_method(screencap_by, "Fallback");
+        {
+            // 不管有没有找到能用的，都重新开始计数，再连续失败几次才再次探测
+            std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+            m_screencap_stats[static_cast<size_t>(method)].consecutive_failures = 0;
         }
-        clear_lf_info();
+        return found;
+    }
+    return ret;
+}
 
-        start_time = high_resolution_clock::now();
-        if (screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect)) {
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time);
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::RawWithGzip;
-                set_inited(true);
-                min_cost = duration;
-            }
-            Log.info("RawWithGzip cost", duration.count(), "ms");
+bool asst::Controller::select_screencap_method(const ScreencapFunc& screencap_by, const std::string& reason)
+{
+    using namespace std::chrono;
+    Log.info("Try to find the fastest way to screencap, reason:", reason);
+
+    ScreencapMethod cur_method = m_adb.screencap_method;
+    ScreencapMethod best_method = ScreencapMethod::UnknownYet;
+    int64_t min_cost = LLONG_MAX;
+
+    auto try_method = [&](ScreencapMethod method) {
+        clear_lf_info();
+        auto start_time = steady_clock::now();
+        bool ret = screencap_by(method);
+        auto cost = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+        record_screencap_result(method, ret, cost);
+        if (!ret) {
+            Log.info(screencap_method_name(method), "is not supported");
+            return;
         }
-        else {
-            Log.info("RawWithGzip is not supported");
+        Log.info(screencap_method_name(method), "cost", cost, "ms");
+        if (cost < min_cost) {
+            best_method = method;
+            min_cost = cost;
         }
-        clear_lf_info();
+    };
 
-        start_time = high_resolution_clock::now();
-        if (screencap(m_adb.screencap_encode, decode_encode, allow_reconnect)) {
-            auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - start_time);
-            if (duration < min_cost) {
-                m_adb.screencap_method = AdbProperty::ScreencapMethod::Encode;
-                set_inited(true);
-                min_cost = duration;
+    if (m_support_socket && m_server_started) {
+        try_method(ScreencapMethod::RawByNc);
+    }
+    else {
+        Log.info("RawByNc is not supported");
+    }
+    try_method(ScreencapMethod::RawWithGzip);
+    try_method(ScreencapMethod::Encode);
+    // 第一帧包含在设备上启动进程的耗时，之后每帧都复用这个进程和连接，所以计时第二帧
+    clear_lf_info();
+    if (m_screencap_stream || screencap_by(ScreencapMethod::RawByStream)) {
+        try_method(ScreencapMethod::RawByStream);
+    }
+    else {
+        Log.info("RawByStream is not supported");
+    }
+    clear_lf_info();
+
+    ScreencapMethod new_method = best_method;
+    if (cur_method != ScreencapMethod::UnknownYet && best_method != ScreencapMethod::UnknownYet &&
+        best_method != cur_method) {
+        // 单次的耗时有偶然性，和当前方式最近的中位数比，明显更快才切换，避免来回切换
+        int64_t cur_p50 = -1;
+        {
+            std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+            const auto& cur_stats = m_screencap_stats[static_cast<size_t>(cur_method)];
+            if (cur_stats.consecutive_failures == 0) {
+                cur_p50 = cur_stats.latency.percentile(50);
             }
-            Log.info("Encode cost", duration.count(), "ms");
         }
-        else {
-            Log.info("Encode is not supported");
+        if (cur_p50 >= 0 && min_cost * 5 >= cur_p50 * 4) {
+            new_method = cur_method;
         }
-        Log.info("The fastest way is", static_cast<int>(m_adb.screencap_method), ", cost:", min_cost.count(), "ms");
-        clear_lf_info();
-        return m_adb.screencap_method != AdbProperty::ScreencapMethod::UnknownYet;
-    } break;
-    case AdbProperty::ScreencapMethod::RawByNc: {
-        return screencap(m_adb.screencap_raw_by_nc, decode_raw, allow_reconnect, true);
-    } break;
-    case AdbProperty::ScreencapMethod::RawWithGzip: {
-        return screencap(m_adb.screencap_raw_with_gzip, decode_raw_with_gzip, allow_reconnect);
-    } break;
-    case AdbProperty::ScreencapMethod::Encode: {
-        return screencap(m_adb.screencap_encode, decode_encode, allow_reconnect);
-    } break;
+    }
+    else if (best_method == ScreencapMethod::UnknownYet && cur_method != ScreencapMethod::UnknownYet) {
+        // 全都失败了，大概是模拟器本身出了问题，还是保留原来的方式，由调用者重试或者重连
+        new_method = cur_method;
     }
 
-    return false;
+    {
+        // get_screencap_stats 可能在其他线程中读取
+        std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+        m_adb.screencap_method = new_method;
+    }
+    m_screencap_selected_time = steady_clock::now();
+    if (new_method != ScreencapMethod::RawByStream) {
+        m_screencap_stream = nullptr;
+    }
+    if (best_method != ScreencapMethod::UnknownYet) {
+        set_inited(true);
+    }
+    Log.info("The fastest way is", screencap_method_name(best_method), ", cost:", min_cost, "ms , use",
+             screencap_method_name(new_method));
+
+    json::value info = json::object {
+        { "uuid", m_uuid },
+        { "what", "ScreencapStats" },
+        { "why", reason },
+        { "details", get_screencap_stats() },
+    };
+    callback(AsstMsg::ConnectionInfo, info);
+
+    return best_method != ScreencapMethod::UnknownYet;
+}
+
+int asst::Controller::record_screencap_result(ScreencapMethod method, bool success, int64_t cost)
+{
+    std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+    auto& stats = m_screencap_stats[static_cast<size_t>(method)];
+    if (success) {
+        stats.latency.add(cost);
+        ++stats.success;
+        stats.consecutive_failures = 0;
+    }
+    else {
+        ++stats.failure;
+        ++stats.consecutive_failures;
+    }
+    return stats.consecutive_failures;
+}
+
+std::string asst::Controller::screencap_method_name(ScreencapMethod method)
+{
+    switch (method) {
+    case ScreencapMethod::RawByNc:
+        return "RawByNc";
+    case ScreencapMethod::RawWithGzip:
+        return "RawWithGzip";
+    case ScreencapMethod::Encode:
+        return "Encode";
+    case ScreencapMethod::RawByStream:
+        return "RawByStream";
+    default:
+        return "UnknownYet";
+    }
+}
+
+json::value asst::Controller::get_screencap_stats() const
+{
+    json::value methods = json::object {};
+    std::unique_lock<std::mutex> stats_lock(m_screencap_stats_mutex);
+    for (size_t i = 0; i < m_screencap_stats.size(); ++i) {
+        const auto& stats = m_screencap_stats[i];
+        if (stats.success == 0 && stats.failure == 0) {
+            continue;
+        }
+        methods[screencap_method_name(static_cast<ScreencapMethod>(i))] = json::object {
+            { "p50", stats.latency.percentile(50) },
+            { "p95", stats.latency.percentile(95) },
+            { "success", stats.success },
+            { "failure", stats.failure },
+        };
+    }
+    return json::object {
+        { "method", screencap_method_name(m_adb.screencap_method) },
+        { "methods", methods },
+    };
+}
+
+size_t asst::Controller::get_frame_alloc_count() const
+{
+    return m_frame_pool.alloc_count();
 }
 
 bool asst::Controller::screencap(const std::string& cmd, const DecodeFunc& decode_func, bool allow_reconnect,
@@ -867,22 +1527,171 @@ bool asst::Controller::screencap(const std::string& cmd, const DecodeFunc& decod
     }
 }
 
+bool asst::Controller::screencap_raw_with_gzip_stream(const DecodeFunc& decode_raw,
+                                                      const DecodeFunc& decode_raw_with_gzip, bool allow_reconnect)
+{
+    // screencap 输出的头部为 12 或 16 字节，多留一些余量；解压结果的大小超出预期就说明有问题，交给原来的方式处理
+    static constexpr size_t MaxHeaderSize = 64;
+    size_t std_size = 4ULL * m_width * m_height;
+    if (std_size == 0) {
+        return false;
+    }
+
+    // 直接解压到复用的内存中，尺寸不变时不会重新分配
+    std::string& buffer = m_spare_payload;
+    buffer.resize(std_size + MaxHeaderSize);
+    GzipInflater inflater(buffer.data(), buffer.size());
+
+    auto ret = call_command(m_adb.screencap_raw_with_gzip, 20000, allow_reconnect, false,
+                            [&](std::string_view chunk) { inflater.feed(chunk); });
+    if (!ret) {
+        return false;
+    }
+    if (!ret->empty()) {
+        // 重连后重新执行的命令会正常返回全部输出
+        return decode_raw_with_gzip(ret.value());
+    }
+    if (!inflater.finished()) {
+        Log.info("stream inflate failed, size:", inflater.size());
+        return false;
+    }
+    buffer.resize(inflater.size());
+    return decode_raw(buffer);
+}
+
+bool asst::Controller::screencap_raw_by_stream(const DecodeFunc& decode_raw)
+{
+    // 需要先用其他 raw 方式截过图，才能知道每帧的头部有多长
+    if (!m_adb_client || m_adb.screencap_raw_stream.empty() || m_screencap_header_size == 0) {
+        return false;
+    }
+    static constexpr int64_t StreamTimeout = 20000;
+    using namespace std::chrono;
+    auto start_time = steady_clock::now();
+
+    if (!m_screencap_stream) {
+        m_screencap_stream =
+            m_adb_client->open_transport(m_adb_serial, "exec:" + m_adb.screencap_raw_stream, StreamTimeout);
+        if (!m_screencap_stream) {
+            Log.info("Open screencap stream failed");
+            return false;
+        }
+    }
+
+    std::string& buffer = m_spare_payload;
+    buffer.resize(m_screencap_header_size + 4ULL * m_width * m_height);
+    // 每发送一个换行，设备上的循环就截一张图
+    if (!m_screencap_stream->write("\n", StreamTimeout) ||
+        !m_screencap_stream->read_exact(buffer.data(), buffer.size(), StreamTimeout)) {
+        Log.warn("Screencap stream broken, close it");
+        m_screencap_stream = nullptr;
+        return false;
+    }
+
+    // 头部的前 8 字节是宽和高，对不上说明数据已经错位了，之后的数据也都不能用
+    uint32_t header_width = 0;
+    uint32_t header_height = 0;
+    std::memcpy(&header_width, buffer.data(), sizeof(header_width));
+    std::memcpy(&header_height, buffer.data() + sizeof(header_width), sizeof(header_height));
+    if ((std::max)(header_width, header_height) != static_cast<uint32_t>(m_width) ||
+        (std::min)(header_width, header_height) != static_cast<uint32_t>(m_height)) {
+        Log.warn("Screencap stream out of sync, header size:", header_width, header_height);
+        m_screencap_stream = nullptr;
+        return false;
+    }
+
+    auto duration = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    Log.info("Screencap by stream, cost", duration, "ms , size:", buffer.size());
+    return decode_raw(buffer);
+}
+
 void asst::Controller::clear_lf_info()
 {
     m_adb.screencap_end_of_line = AdbProperty::ScreencapEndOfLine::UnknownYet;
 }
 
+bool asst::Controller::screencap_frame(bool allow_reconnect, bool prefetched)
+{
+    FrameInfo info;
+    info.time = std::chrono::steady_clock::now();
+    info.action_id = m_completed_id;
+    info.prefetched = prefetched;
+    if (!screencap(allow_reconnect)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+    info.seq = m_frame_info.seq + 1;
+    m_frame_info = info;
+    image_lock.unlock();
+    // 只有持有 m_screencap_mutex 时才会修改 m_cache_image，所以这里不需要再锁 m_image_mutex
+    if (auto cur_recorder = recorder()) {
+        cur_recorder->add_frame(m_cache_image, info.seq, info.action_id);
+    }
+    return true;
+}
+
+bool asst::Controller::is_blank_frame(std::string_view img_data)
+{
+    // 抽样检查约 4096 个像素，一个非零的都没有就认为是全黑的无效截图，不必扫描整张图
+    static constexpr size_t SampleCount = 4096;
+    size_t pixel_count = img_data.size() / 4;
+    // 步长取奇数，避免和行宽对齐后只抽到同一列
+    size_t stride = (std::max)(pixel_count / SampleCount, size_t(1)) | 1;
+    for (size_t i = 0; i < pixel_count; i += stride) {
+        const char* pixel = img_data.data() + i * 4;
+        if (pixel[0] || pixel[1] || pixel[2] || pixel[3]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const cv::Mat& asst::Controller::get_cached_resized_image() const
+{
+    const cv::Size d_size(m_scale_size.first, m_scale_size.second);
+
+    if (m_derived_cache.generation == m_cache_generation && !m_derived_cache.resized.empty()) {
+        return m_derived_cache.resized;
+    }
+    m_derived_cache = DerivedCache();
+    m_derived_cache.generation = m_cache_generation;
+
+    cv::Mat resized_mat = m_frame_pool.acquire(d_size, CV_8UC3);
+    if (m_cache_image.type() == CV_8UC4) {
+        // raw 截图缓存的是 RGBA：先在 4 通道上缩放，再只对缩放后的小图转换颜色，不需要生成全尺寸的 BGR 图
+        // 缩放对每个通道是独立计算的，所以和先转换再缩放的结果完全一致
+        if (m_cache_image.size() == d_size) {
+            cv::cvtColor(m_cache_image, resized_mat, cv::COLOR_RGBA2BGR);
+        }
+        else {
+            cv::Mat resized_rgba = m_frame_pool.acquire(d_size, CV_8UC4);
+            cv::resize(m_cache_image, resized_rgba, d_size, 0.0, 0.0, cv::INTER_AREA);
+            cv::cvtColor(resized_rgba, resized_mat, cv::COLOR_RGBA2BGR);
+        }
+    }
+    else if (m_cache_image.size() == d_size) {
+        m_cache_image.copyTo(resized_mat);
+    }
+    else {
+        cv::resize(m_cache_image, resized_mat, d_size, 0.0, 0.0, cv::INTER_AREA);
+    }
+    m_derived_cache.resized = resized_mat;
+    return m_derived_cache.resized;
+}
+
 cv::Mat asst::Controller::get_resized_image() const
 {
-    const static cv::Size d_size(m_scale_size.first, m_scale_size.second);
+    const cv::Size d_size(m_scale_size.first, m_scale_size.second);
 
     std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
     if (m_cache_image.empty()) {
         Log.error("image is empty");
         return { d_size, CV_8UC3 };
     }
-    cv::Mat resized_mat;
-    cv::resize(m_cache_image, resized_mat, d_size, 0.0, 0.0, cv::INTER_AREA);
+    std::unique_lock<std::mutex> derived_lock(m_derived_mutex);
+    // 缓存的图会被多次返回，调用者可能会修改返回的图，所以给一份拷贝
+    cv::Mat resized_mat = m_frame_pool.acquire(d_size, CV_8UC3);
+    get_cached_resized_image().copyTo(resized_mat);
     return resized_mat;
 }
 
@@ -893,7 +1702,7 @@ std::optional<int> asst::Controller::start_game(const std::string& client_type,
     }
     if (auto intent_name = Configer.get_intent_name(client_type)) {
         std::string cur_cmd = utils::string_replace_all(m_adb.start, "[Intent]", intent_name.value());
-        int id = push_cmd(cur_cmd);
+        int id = push_cmd("start " + intent_name.value(), cur_cmd);
         if (block) {
             wait(id);
         }
@@ -905,7 +1714,7 @@ std::optional<int> asst::Controller::start_game(const std::string& client_type,
 std::optional<int> asst::Controller::stop_game(bool block)
 {
     std::string cur_cmd = m_adb.stop;
-    int id = push_cmd(cur_cmd);
+    int id = push_cmd("stop", cur_cmd);
     if (block) {
         wait(id);
     }
@@ -931,9 +1740,13 @@ int asst::Controller::click_without_scale(const Point& p, bool block)
     if (p.x < 0 || p.x >= m_width || p.y < 0 || p.y >= m_height) {
         Log.error("click point out of range");
     }
-    std::string cur_cmd =
-        utils::string_replace_all(m_adb.click, { { "[x]", std::to_string(p.x) }, { "[y]", std::to_string(p.y) } });
-    int id = push_cmd(cur_cmd);
+    auto cmd_replace = [&](const std::string& cfg_cmd) -> std::string {
+        return utils::string_replace_all(cfg_cmd, { { "[x]", std::to_string(p.x) }, { "[y]", std::to_string(p.y) } });
+    };
+    std::string cur_cmd = cmd_replace(m_adb.click);
+    std::string shell_cmd = m_adb.shell_click.empty() ? std::string() : cmd_replace(m_adb.shell_click);
+    std::string action = "click " + std::to_string(p.x) + " " + std::to_string(p.y);
+    int id = push_cmd(std::move(action), cur_cmd, shell_cmd);
     if (block) {
         wait(id);
     }
@@ -975,32 +1788,45 @@ int asst::Controller::swipe_without_scale(const Point& p1, const Point& p2, int
         y1 = std::clamp(y1, 0, m_height - 1);
     }
 
-    std::string cur_cmd =
-        utils::string_replace_all(m_adb.swipe, {
-                                                   { "[x1]", std::to_string(x1) },
-                                                   { "[y1]", std::to_string(y1) },
-                                                   { "[x2]", std::to_string(x2) },
-                                                   { "[y2]", std::to_string(y2) },
-                                                   { "[duration]", duration <= 0 ? "" : std::to_string(duration) },
-                                               });
+    auto cmd_replace = [&](const std::string& cfg_cmd) -> std::string {
+        return utils::string_replace_all(cfg_cmd, {
+                                                      { "[x1]", std::to_string(x1) },
+                                                      { "[y1]", std::to_string(y1) },
+                                                      { "[x2]", std::to_string(x2) },
+                                                      { "[y2]", std::to_string(y2) },
+                                                      { "[duration]", duration <= 0 ? "" : std::to_string(duration) },
+                                                  });
+    };
+    std::string cur_cmd = cmd_replace(m_adb.swipe);
+    std::string shell_cmd = m_adb.shell_swipe.empty() ? std::string() : cmd_replace(m_adb.shell_swipe);
+    auto swipe_action = [](int sx1, int sy1, int sx2, int sy2, int swipe_duration) -> std::string {
+        return "swipe " + std::to_string(sx1) + " " + std::to_string(sy1) + " " + std::to_string(sx2) + " " +
+               std::to_string(sy2) + " " + std::to_string(swipe_duration);
+    };
 
     int id = 0;
     // 额外的滑动：adb有bug，同样的参数，偶尔会划得非常远。额外做一个短程滑动，把之前的停下来
     const auto& opt = Configer.get_options();
     if (extra_swipe && opt.adb_extra_swipe_duration > 0) {
-        std::string extra_cmd = utils::string_replace_all(
-            m_adb.swipe, {
+        auto extra_cmd_replace = [&](const std::string& cfg_cmd) -> std::string {
+            return utils::string_replace_all(
+                cfg_cmd, {
                              { "[x1]", std::to_string(x2) },
                              { "[y1]", std::to_string(y2) },
                              { "[x2]", std::to_string(x2) },
                              { "[y2]", std::to_string(y2 - opt.adb_extra_swipe_dist /* * m_control_scale*/) },
                              { "[duration]", std::to_string(opt.adb_extra_swipe_duration) },
                          });
-        push_cmd(cur_cmd);
-        id = push_cmd(extra_cmd);
+        };
+        std::string extra_cmd = extra_cmd_replace(m_adb.swipe);
+        std::string extra_shell_cmd =
+            m_adb.shell_swipe.empty() ? std::string() : extra_cmd_replace(m_adb.shell_swipe);
+        push_cmd(swipe_action(x1, y1, x2, y2, duration), cur_cmd, shell_cmd);
+        id = push_cmd(swipe_action(x2, y2, x2, y2 - opt.adb_extra_swipe_dist, opt.adb_extra_swipe_duration),
+                      extra_cmd, extra_shell_cmd);
     }
     else {
-        id = push_cmd(cur_cmd);
+        id = push_cmd(swipe_action(x1, y1, x2, y2, duration), cur_cmd, shell_cmd);
     }
 
     if (block) {
@@ -1020,6 +1846,8 @@ int asst::Controller::swipe_without_scale(const Rect& r1, const Rect& r2, int du
 bool asst::Controller::connect(const std::string& adb_path, const std::string& address, const std::string& config)
 {
     LogTraceFunction;
+    // 连接过程中会修改截图方式等信息，不能和后台的预截图同时进行
+    std::unique_lock<std::mutex> screencap_lock(m_screencap_mutex);
 
     clear_info();
 
@@ -1042,6 +1870,10 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         };
     };
 
+    if (config == "Replay") {
+        return connect_replay(address, get_info_json());
+    }
+
     auto adb_ret = Configer.get_adb_cfg(config);
     if (!adb_ret) {
         json::value info = get_info_json() | json::object {
@@ -1053,6 +1885,13 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
     }
 
     const auto& adb_cfg = adb_ret.value();
+    m_adb_path = adb_path;
+    m_adb_serial = address;
+    if (Configer.get_options().adb_native) {
+        // server 还没启动的话，第一次 connect 会回退到 adb 进程，由它把 server 拉起来
+        m_adb_client = std::make_unique<AdbClient>();
+    }
+
     std::string display_id;
     std::string nc_address = "10.0.2.2";
     uint16_t nc_port = 0;
@@ -1213,24 +2052,7 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         return false;
     }
 
-    /* calc ratio */
-    {
-        constexpr double DefaultRatio =
-            static_cast<double>(WindowWidthDefault) / static_cast<double>(WindowHeightDefault);
-        double cur_ratio = static_cast<double>(m_width) / static_cast<double>(m_height);
-
-        if (cur_ratio >= DefaultRatio // 说明是宽屏或默认16:9，按照高度计算缩放
-            || std::fabs(cur_ratio - DefaultRatio) < DoubleDiff) {
-            int scale_width = static_cast<int>(cur_ratio * WindowHeightDefault);
-            m_scale_size = std::make_pair(scale_width, WindowHeightDefault);
-            m_control_scale = static_cast<double>(m_height) / static_cast<double>(WindowHeightDefault);
-        }
-        else { // 否则可能是偏正方形的屏幕，按宽度计算
-            int scale_height = static_cast<int>(WindowWidthDefault / cur_ratio);
-            m_scale_size = std::make_pair(WindowWidthDefault, scale_height);
-            m_control_scale = static_cast<double>(m_width) / static_cast<double>(WindowWidthDefault);
-        }
-    }
+    init_scale_size();
 
     {
         json::value info = get_info_json() | json::object {
@@ -1242,8 +2064,12 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
 
     m_adb.click = cmd_replace(adb_cfg.click);
     m_adb.swipe = cmd_replace(adb_cfg.swipe);
+    m_adb.shell = cmd_replace(adb_cfg.shell);
+    m_adb.shell_click = cmd_replace(adb_cfg.shell_click);
+    m_adb.shell_swipe = cmd_replace(adb_cfg.shell_swipe);
     m_adb.screencap_raw_with_gzip = cmd_replace(adb_cfg.screencap_raw_with_gzip);
     m_adb.screencap_encode = cmd_replace(adb_cfg.screencap_encode);
+    m_adb.screencap_raw_stream = adb_cfg.screencap_raw_stream;
     m_adb_release = m_adb.release = cmd_replace(adb_cfg.release);
     m_adb.start = cmd_replace(adb_cfg.start);
     m_adb.stop = cmd_replace(adb_cfg.stop);
@@ -1283,15 +2109,80 @@ bool asst::Controller::connect(const std::string& adb_path, const std::string& a
         }
     }
 
+    // 常驻 shell 打不开也不影响使用，点击和滑动会回退到每次单独启动 adb 进程
+    if (open_shell()) {
+        static constexpr int64_t ShellProbeTimeout = 5000;
+        if (!call_shell_once("true", ShellProbeTimeout).succeeded()) {
+            Log.warn("Shell is not available, fallback to call command");
+            close_shell();
+        }
+    }
+
+    if (need_exit()) {
+        return false;
+    }
+
     // try to find the fastest way
     if (!screencap()) {
         Log.error("Cannot find a proper way to screencap!");
         return false;
     }
 
+    if (Configer.get_options().session_record) {
+        std::string stem = utils::get_format_time();
+        stem = utils::string_replace_all(stem, { { ":", "-" }, { " ", "_" } });
+        start_recording(UserDir::get_instance().get() / "debug" / "sessions" / (stem + ".maarec"));
+    }
+
     return true;
 }
 
+bool asst::Controller::connect_replay(const std::string& path, json::value info)
+{
+    m_replay = ReplaySession::open(utils::path(path));
+    if (!m_replay) {
+        info |= json::object {
+            { "what", "ConnectFailed" },
+            { "why", "Replay open failed" },
+        };
+        callback(AsstMsg::ConnectionInfo, info);
+        return false;
+    }
+
+    m_uuid = "Replay";
+    m_width = m_replay->frame_size().width;
+    m_height = m_replay->frame_size().height;
+    init_scale_size();
+
+    info["uuid"] = m_uuid;
+    info |= json::object {
+        { "what", "Connected" },
+        { "why", "" },
+    };
+    callback(AsstMsg::ConnectionInfo, info);
+
+    set_inited(true);
+    return screencap();
+}
+
+void asst::Controller::init_scale_size()
+{
+    constexpr double DefaultRatio = static_cast<double>(WindowWidthDefault) / static_cast<double>(WindowHeightDefault);
+    double cur_ratio = static_cast<double>(m_width) / static_cast<double>(m_height);
+
+    if (cur_ratio >= DefaultRatio // 说明是宽屏或默认16:9，按照高度计算缩放
+        || std::fabs(cur_ratio - DefaultRatio) < DoubleDiff) {
+        int scale_width = static_cast<int>(cur_ratio * WindowHeightDefault);
+        m_scale_size = std::make_pair(scale_width, WindowHeightDefault);
+        m_control_scale = static_cast<double>(m_height) / static_cast<double>(WindowHeightDefault);
+    }
+    else { // 否则可能是偏正方形的屏幕，按宽度计算
+        int scale_height = static_cast<int>(WindowWidthDefault / cur_ratio);
+        m_scale_size = std::make_pair(WindowWidthDefault, scale_height);
+        m_control_scale = static_cast<double>(m_width) / static_cast<double>(WindowWidthDefault);
+    }
+}
+
 bool asst::Controller::set_inited(bool inited)
 {
     Log.trace(__FUNCTION__, "|", inited, ", m_inited =", m_inited, ", m_instance_count =", m_instance_count);
@@ -1316,33 +2207,22 @@ bool asst::Controller::set_inited(bool inited)
 void asst::Controller::kill_adb_daemon()
 {
     if (m_instance_count) return;
-#ifndef _WIN32
-    if (m_child)
-#endif
-    {
-        if (!m_adb_release.empty()) {
-            call_command(m_adb_release, 20000, false);
-            m_adb_release.clear();
-        }
+    if (!m_adb_release.empty()) {
+        call_command(m_adb_release, 20000, false);
+        m_adb_release.clear();
     }
 }
 
 bool asst::Controller::release()
 {
+    close_shell();
     try_to_close_socket();
 
-#ifndef _WIN32
-    if (m_child)
-#endif
-    {
-        if (m_adb.release.empty()) {
-            return true;
-        }
-        else {
-            m_adb_release.clear();
-            return call_command(m_adb.release, 20000, false).has_value();
-        }
+    if (m_adb.release.empty()) {
+        return true;
     }
+    m_adb_release.clear();
+    return call_command(m_adb.release, 20000, false).has_value();
 }
 
 bool asst::Controller::inited() const noexcept
@@ -1361,46 +2241,158 @@ const std::string& asst::Controller::get_uuid() const
 }
 
 cv::Mat asst::Controller::get_image(bool raw)
+{
+    return get_image(std::chrono::steady_clock::now(), 0, raw, false);
+}
+
+cv::Mat asst::Controller::get_image_after(std::chrono::steady_clock::time_point time, bool raw)
+{
+    return get_image(time, last_action_id(), raw, Configer.get_options().screencap_prefetch);
+}
+
+asst::Controller::FrameInfo asst::Controller::get_frame_info() const
+{
+    std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+    return m_frame_info;
+}
+
+bool asst::Controller::wait_for_screen(ScreenWaitType type, const Rect& roi, int timeout, const cv::Mat& reference,
+                                       int interval, int stable_times)
+{
+    LogTraceFunction;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto deadline = start_time + std::chrono::milliseconds(timeout);
+    const auto interval_ms = std::chrono::milliseconds((std::max)(interval, 1));
+    auto signature_of = [&](const cv::Mat& image) -> uint64_t {
+        cv::Rect cv_roi = roi.empty() ? cv::Rect(0, 0, image.cols, image.rows) : make_rect<cv::Rect>(roi);
+        return utils::roi_signature(image, cv_roi);
+    };
+
+    std::optional<uint64_t> ref_signature;
+    if (!reference.empty()) {
+        ref_signature = signature_of(reference);
+    }
+    std::optional<uint64_t> last_signature;
+    int same_times = 0;
+    int frame_count = 0;
+    auto next_time = start_time;
+    while (!need_exit()) {
+        cv::Mat image = get_image_after(next_time);
+        if (image.empty()) {
+            break;
+        }
+        ++frame_count;
+        uint64_t signature = signature_of(image);
+        bool done = false;
+        switch (type) {
+        case ScreenWaitType::Changed:
+            if (!ref_signature) {
+                ref_signature = signature;
+            }
+            done = signature != *ref_signature;
+            break;
+        case ScreenWaitType::Stable:
+            same_times = last_signature == signature ? same_times + 1 : 0;
+            done = same_times >= stable_times && signature != ref_signature;
+            break;
+        default:
+            break;
+        }
+        last_signature = signature;
+        if (done) {
+            Log.trace("Screen", type == ScreenWaitType::Changed ? "changed" : "stable", "after",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                            start_time)
+                          .count(),
+                      "ms,", frame_count, "frames");
+            return true;
+        }
+
+        // 截图本身比 interval 慢时不再额外等待
+        next_time = (std::max)(next_time + interval_ms, std::chrono::steady_clock::now());
+        if (next_time >= deadline) {
+            break;
+        }
+    }
+    Log.trace("Wait for screen timeout,", frame_count, "frames");
+    return false;
+}
+
+cv::Mat asst::Controller::get_image(std::chrono::steady_clock::time_point after, unsigned action_id, bool raw,
+                                    bool prefetch)
 {
     if (m_scale_size.first == 0 || m_scale_size.second == 0) {
         Log.error("Unknown image size");
         return {};
     }
 
-    // 有些模拟器adb偶尔会莫名其妙截图失败，多试几次
-    static constexpr int MaxTryCount = 20;
-    bool success = false;
-    for (int i = 0; i < MaxTryCount && inited(); ++i) {
-        if (need_exit()) {
-            break;
+    if (after > std::chrono::steady_clock::now()) {
+        std::this_thread::sleep_until(after);
+    }
+    auto frame_satisfied = [&]() -> bool {
+        std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+        // 只复用后台线程预先截的图，调用者自己截过的图一律重新截，与未开启预截图时的行为保持一致
+        return m_frame_info.seq != 0 && m_frame_info.prefetched && m_frame_info.time >= after &&
+               m_frame_info.action_id >= action_id;
+    };
+
+    std::unique_lock<std::mutex> screencap_lock(m_screencap_mutex);
+    // 等锁的时候后台线程可能刚好截到了一张满足条件的图
+    if (!frame_satisfied()) {
+        wait(action_id);
+
+        // 有些模拟器adb偶尔会莫名其妙截图失败，多试几次
+        static constexpr int MaxTryCount = 20;
+        bool success = false;
+        for (int i = 0; i < MaxTryCount && inited(); ++i) {
+            if (need_exit()) {
+                break;
+            }
+            if (screencap_frame()) {
+                success = true;
+                break;
+            }
         }
-        if (screencap()) {
-            success = true;
+        while (!success && !need_exit()) {
+            if (screencap_frame(true)) {
+                break;
+            }
+            Log.error(__FUNCTION__, "screencap failed!");
+            json::value info = json::object {
+                { "uuid", m_uuid },
+                { "what", "ScreencapFailed" },
+                { "why", "ScreencapFailed" },
+                { "details", json::object {} },
+            };
+            callback(AsstMsg::ConnectionInfo, info);
+
+            const cv::Size d_size(m_scale_size.first, m_scale_size.second);
+            std::unique_lock<std::shared_mutex> image_lock(m_image_mutex);
+            m_cache_image = cv::Mat(d_size, CV_8UC3);
+            ++m_cache_generation;
+            m_cache_payload.clear();
+
             break;
         }
     }
-    while (!success && !need_exit()) {
-        if (screencap(true)) {
-            break;
-        }
-        Log.error(__FUNCTION__, "screencap failed!");
-        json::value info = json::object {
-            { "uuid", m_uuid },
-            { "what", "ScreencapFailed" },
-            { "why", "ScreencapFailed" },
-            { "details", json::object {} },
-        };
-        callback(AsstMsg::ConnectionInfo, info);
+    screencap_lock.unlock();
 
-        const static cv::Size d_size(m_scale_size.first, m_scale_size.second);
-        m_cache_image = cv::Mat(d_size, CV_8UC3);
-
-        break;
+    if (prefetch) {
+        std::unique_lock<std::mutex> frame_lock(m_frame_mutex);
+        m_frame_prefetch = true;
+        m_frame_condvar.notify_all();
     }
 
     if (raw) {
         std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
-        cv::Mat copy = m_cache_image.clone();
+        cv::Mat copy;
+        if (m_cache_image.type() == CV_8UC4) {
+            cv::cvtColor(m_cache_image, copy, cv::COLOR_RGBA2BGR);
+        }
+        else {
+            copy = m_cache_image.clone();
+        }
         return copy;
     }
 
@@ -1409,9 +2401,19 @@ cv::Mat asst::Controller::get_image(bool raw)
 
 std::vector<uchar> asst::Controller::get_image_encode() const
 {
-    cv::Mat img = get_resized_image();
-    std::vector<uchar> buf;
-    cv::imencode(".png", img, buf);
-
-    return buf;
+    std::shared_lock<std::shared_mutex> image_lock(m_image_mutex);
+    if (m_cache_image.empty()) {
+        image_lock.unlock();
+        cv::Mat img = get_resized_image();
+        std::vector<uchar> buf;
+        cv::imencode(".png", img, buf);
+        return buf;
+    }
+    // GUI 会反复获取截图，没有新截图时直接返回上次编码的结果
+    std::unique_lock<std::mutex> derived_lock(m_derived_mutex);
+    const cv::Mat& img = get_cached_resized_image();
+    if (m_derived_cache.png.empty()) {
+        cv::imencode(".png", img, m_derived_cache.png);
+    }
+    return m_derived_cache.png;
 }
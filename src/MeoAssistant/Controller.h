@@ -7,8 +7,12 @@
 
 #include "Utils/AsstConf.h"
 
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <filesystem>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -16,16 +20,24 @@
 #include <random>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 
 #include "Utils/NoWarningCVMat.h"
 
 #include "Utils/AsstMsg.h"
 #include "Utils/AsstTypes.h"
+#include "Utils/FrameBufferPool.hpp"
+#include "Utils/LatencyWindow.hpp"
 #include "Utils/SingletonHolder.hpp"
 
 namespace asst
 {
+    class AdbClient;
+    class AdbStream;
+    class ReplaySession;
+    class SessionRecorder;
+
     class Controller
     {
     public:
@@ -34,6 +46,7 @@ namespace asst
         Controller(Controller&&) = delete;
         ~Controller();
 
+        // config 为 "Replay" 时不连接模拟器，而是回放 address 目录中录制的截图，见 ReplaySession
         bool connect(const std::string& adb_path, const std::string& address, const std::string& config);
         bool inited() const noexcept;
         void set_exit_flag(bool* flag);
@@ -42,6 +55,32 @@ namespace asst
         cv::Mat get_image(bool raw = false);
         std::vector<uchar> get_image_encode() const;
 
+        struct FrameInfo
+        {
+            uint64_t seq = 0;                           // 截图序号，每成功截图一次加一，0 表示还没有截过图
+            std::chrono::steady_clock::time_point time; // 开始截图的时间
+            unsigned action_id = 0;                     // 开始截图时已经执行完的操作 id（即 click 等的返回值）
+            bool prefetched = false;                    // 是否是后台线程预先截的图
+        };
+        // 获取一张开始截图时间不早于 time 的截图，并且保证截图开始前，调用前下发的点击、滑动等操作都已执行完
+        // 开启 screencapPrefetch 时，取走一张截图后会在后台线程立即开始截下一张，调用者分析图像的同时下一帧已经在路上了
+        // 与 get_image 不同，后台线程截好的图满足条件时会直接使用；其他截图不会被重复使用，每次都重新截图
+        cv::Mat get_image_after(std::chrono::steady_clock::time_point time, bool raw = false);
+        FrameInfo get_frame_info() const;
+        // 每隔 interval 毫秒截一次图，比较 roi（为空时为全图）缩小后的签名，最多等待 timeout 毫秒，等到了返回 true
+        // Changed: 画面与 reference 不同（没有 reference 时与第一张截图比较）
+        // Stable: 连续 stable_times 次截图都没有变化；有 reference 时还要求与 reference 不同，即先变化再稳定
+        bool wait_for_screen(ScreenWaitType type, const Rect& roi, int timeout, const cv::Mat& reference = cv::Mat(),
+                             int interval = 100, int stable_times = 2);
+
+        // 把之后的每张截图和每个操作录制到 path，可以通过 "Replay" 连接回放
+        bool start_recording(const std::filesystem::path& path);
+        void stop_recording();
+        // 当前使用的截图方式，以及各方式最近的耗时（p50、p95，单位毫秒）和成功、失败次数
+        json::value get_screencap_stats() const;
+        // 截图缩放、转换颜色累计分配大块内存的次数，见 FrameBufferPool
+        size_t get_frame_alloc_count() const;
+
         /* 开启游戏、点击和滑动都是异步执行，返回该任务的id */
 
         std::optional<int> start_game(const std::string& client_type, bool block = true);
@@ -74,22 +113,71 @@ namespace asst
     private:
         bool need_exit() const;
         void pipe_working_proc();
+        void screencap_working_proc();
+        // 传入 on_stdout 时，stdout 每收到一段就交给它处理，不再保存到返回值中
+        // 注意重连后重新执行的命令不会再调用 on_stdout，而是正常返回全部输出
+        using OutputSink = std::function<void(std::string_view)>;
         std::optional<std::string> call_command(const std::string& cmd, int64_t timeout = 20000,
-                                                bool allow_reconnect = true, bool recv_by_socket = false);
-        int push_cmd(const std::string& cmd);
+                                                bool allow_reconnect = true, bool recv_by_socket = false,
+                                                const OutputSink& on_stdout = nullptr);
+        struct NativeCallResult
+        {
+            // 命令已经交给 adb server 执行了，不论成败都不能再启动 adb 进程重复执行一遍
+            bool handled = false;
+            std::optional<std::string> output; // 执行成功时的输出
+        };
+        // 能转换为 adb server 服务请求的命令，直接通过 AdbClient 执行
+        // 不支持、或者与 adb server 通信失败（命令没有执行）时 handled 为 false，由调用者回退到 adb 进程
+        NativeCallResult call_command_by_native(const std::string& cmd, int64_t timeout,
+                                                const OutputSink& on_stdout = nullptr);
+        // action 为操作的描述，例如 "click 100 200"，用于录制和回放
+        int push_cmd(std::string action, const std::string& cmd, const std::string& shell_cmd = std::string());
         bool release();
         void kill_adb_daemon();
         bool set_inited(bool inited);
+        bool connect_replay(const std::string& path, json::value info);
+        std::shared_ptr<SessionRecorder> recorder();
+        // 根据 m_width、m_height 计算缩放比例
+        void init_scale_size();
+
+        // 常驻的 adb shell 会话：点击、滑动等命令直接写入 shell 的 stdin，省去每次启动 adb 进程的开销
+        bool open_shell();
+        void close_shell() noexcept;
+        struct ShellCallResult
+        {
+            // 命令是否已经完整写入 shell。写入后即使等不到结果也不能重发，否则点击、滑动可能被执行多次
+            bool sent = false;
+            std::optional<int> exit_code; // 读到结束标记时命令的返回值，超时或 shell 断开时为空
+            std::string output;
+
+            bool succeeded() const noexcept { return exit_code == 0; }
+        };
+        // 写入失败（命令没有发出去）时会重新打开 shell 再试一次；已经发出去的命令不会重发
+        ShellCallResult call_shell(const std::string& shell_cmd, int64_t timeout = 20000);
+        ShellCallResult call_shell_once(const std::string& shell_cmd, int64_t timeout);
 
         void try_to_close_socket() noexcept;
         std::optional<unsigned short> try_to_init_socket(const std::string& local_address);
 
-        using DecodeFunc = std::function<bool(std::string_view)>;
+        // 解码成功时可以接管 data 的内存
+        using DecodeFunc = std::function<bool(std::string&)>;
         bool screencap(bool allow_reconnect = false);
         bool screencap(const std::string& cmd, const DecodeFunc& decode_func, bool allow_reconnect = false,
                        bool by_socket = false);
+        // 边接收 adb 的输出边解压，直接写入预先分配好的内存；失败时由调用者回退到先接收完再解压
+        bool screencap_raw_with_gzip_stream(const DecodeFunc& decode_raw, const DecodeFunc& decode_raw_with_gzip,
+                                            bool allow_reconnect);
+        // 在设备上常驻一个循环截图的进程，通过同一条 adb 连接按需取回一帧，省去每帧启动进程、建立连接的开销
+        bool screencap_raw_by_stream(const DecodeFunc& decode_raw);
         void clear_lf_info();
+        static bool is_blank_frame(std::string_view img_data);
         cv::Mat get_resized_image() const;
+        // 返回当前截图缩放后的图，同一张截图只缩放一次；需要持有 m_image_mutex 和 m_derived_mutex
+        const cv::Mat& get_cached_resized_image() const;
+        // 截图成功后更新 m_frame_info，需要持有 m_screencap_mutex
+        bool screencap_frame(bool allow_reconnect = false, bool prefetched = false);
+        cv::Mat get_image(std::chrono::steady_clock::time_point after, unsigned action_id, bool raw, bool prefetch);
+        unsigned last_action_id();
 
         Point rand_point_in_rect(const Rect& rect);
 
@@ -121,10 +209,26 @@ namespace asst
         static constexpr int PIPE_READ = 0;
         static constexpr int PIPE_WRITE = 1;
         int m_pipe_in[2] = { 0 };
-        int m_pipe_out[2] = { 0 };
         int m_child = 0;
 #endif
 
+        std::mutex m_shell_mutex;
+#ifdef _WIN32
+        HANDLE m_shell_process = nullptr;
+        HANDLE m_shell_stdin = INVALID_HANDLE_VALUE;
+        HANDLE m_shell_stdout = INVALID_HANDLE_VALUE;
+        OVERLAPPED m_shell_ov {};
+        bool m_shell_read_pending = false;
+#else
+        int m_shell_child = 0;
+        int m_shell_in = -1;
+        int m_shell_out = -1;
+#endif
+        static constexpr size_t ShellBufferSize = 4096;
+        std::unique_ptr<char[]> m_shell_buffer;
+        std::string m_shell_output; // shell 中尚未被消费的输出
+        unsigned m_shell_seq = 0;   // 用于生成每条命令的结束标记
+
         struct AdbProperty
         {
             /* command */
@@ -132,9 +236,14 @@ namespace asst
             std::string click;
             std::string swipe;
 
+            std::string shell;
+            std::string shell_click;
+            std::string shell_swipe;
+
             std::string screencap_raw_by_nc;
             std::string screencap_raw_with_gzip;
             std::string screencap_encode;
+            std::string screencap_raw_stream;
             std::string release;
 
             std::string start;
@@ -155,10 +264,33 @@ namespace asst
                 // Default,
                 RawByNc,
                 RawWithGzip,
-                Encode
+                Encode,
+                RawByStream
             } screencap_method = ScreencapMethod::UnknownYet;
         } m_adb;
 
+        std::unique_ptr<AdbClient> m_adb_client;
+        std::unique_ptr<AdbStream> m_screencap_stream; // 需要在 m_adb_client 之前释放
+        size_t m_screencap_header_size = 0;            // raw 截图的头部长度，成功截过一次 raw 才知道
+        std::unique_ptr<ReplaySession> m_replay;       // 回放模式下，截图和操作都由它处理
+        std::shared_ptr<SessionRecorder> m_recorder;   // 录制中时非空，由 m_recorder_mutex 保护
+        std::mutex m_recorder_mutex;
+
+        struct ScreencapStats
+        {
+            LatencyWindow latency; // 只统计成功的截图
+            uint64_t success = 0;
+            uint64_t failure = 0;
+            int consecutive_failures = 0;
+        };
+        static constexpr size_t ScreencapMethodCount = 5;
+        std::array<ScreencapStats, ScreencapMethodCount> m_screencap_stats; // 以 ScreencapMethod 为下标
+        mutable std::mutex m_screencap_stats_mutex;
+        std::chrono::steady_clock::time_point m_screencap_selected_time; // 上次选择截图方式的时间
+        std::chrono::steady_clock::time_point m_screencap_fallback_time; // 上次因为连续失败而重新探测的时间
+        std::string m_adb_path;
+        std::string m_adb_serial;
+
         std::string m_uuid;
         inline static std::string m_adb_release; // 开了 adb daemon，但是没连上模拟器的时候，
                                                  // m_adb 并不会存下 release 的命令，但最后仍然需要一次释放。
@@ -173,18 +305,55 @@ namespace asst
         inline static int m_instance_count = 0;
 
         mutable std::shared_mutex m_image_mutex;
+        // raw 方式截图时为直接引用 m_cache_payload 的 RGBA 图，其他方式为 BGR 图
         cv::Mat m_cache_image;
+        std::string m_cache_payload;
+        std::string m_spare_payload; // 上一帧的 payload，留给下一帧复用，只在截图的线程中使用
+        uint64_t m_cache_generation = 0; // m_cache_image 每变化一次加一
+
+        // 由当前截图计算出来的各种形式，截图变化后失效
+        struct DerivedCache
+        {
+            uint64_t generation = 0;
+            cv::Mat resized;
+            std::vector<uchar> png;
+        };
+        mutable std::mutex m_derived_mutex;
+        mutable DerivedCache m_derived_cache;
+        mutable FrameBufferPool m_frame_pool;
+        FrameInfo m_frame_info; // m_cache_image 对应的截图信息，同样由 m_image_mutex 保护
+
+        std::mutex m_screencap_mutex; // 保证同一时间只有一个线程在截图
+        std::mutex m_frame_mutex;
+        std::condition_variable m_frame_condvar;
+        bool m_frame_prefetch = false; // 需要后台线程预先截一张图
+        std::thread m_screencap_thread;
 
         bool m_thread_exit = false;
         // bool m_thread_idle = true;
         std::mutex m_cmd_queue_mutex;
         std::condition_variable m_cmd_condvar;
-        std::queue<std::string> m_cmd_queue;
+        struct CmdItem
+        {
+            std::string cmd;       // 完整的命令，单独启动一个进程执行
+            std::string shell_cmd; // 非空时优先写入常驻 shell 执行，失败再回退到 cmd
+            std::string action;    // 操作的描述，回放时代替 cmd
+        };
+        std::queue<CmdItem> m_cmd_queue;
         std::atomic<unsigned> m_completed_id = 0;
         unsigned m_push_id = 0; // push_id的自增总是伴随着queue的push，肯定是要上锁的，所以没必要原子
         std::thread m_cmd_thread;
 
     private:
+        // 用到了上面定义的 AdbProperty，所以声明在这里
+        using ScreencapMethod = AdbProperty::ScreencapMethod;
+        using ScreencapFunc = std::function<bool(ScreencapMethod)>;
+        // 每种方式各截一张图，选出最快的；已经选定过时，新的方式需要明显更快才会切换
+        bool select_screencap_method(const ScreencapFunc& screencap_by, const std::string& reason);
+        // 记录一次截图的结果，返回该方式连续失败的次数
+        int record_screencap_result(ScreencapMethod method, bool success, int64_t cost);
+        static std::string screencap_method_name(ScreencapMethod method);
+
 #ifdef _WIN32
         // for Windows socket
         class WsaHelper : public SingletonHolder<WsaHelper>
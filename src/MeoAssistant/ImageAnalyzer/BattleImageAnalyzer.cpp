@@ -5,6 +5,7 @@
 
 #include "Utils/NoWarningCV.h"
 
+#include "General/FrameContext.h"
 #include "General/HashImageAnalyzer.h"
 #include "General/MatchImageAnalyzer.h"
 #include "General/MultiMatchImageAnalyzer.h"
@@ -223,9 +224,7 @@ bool asst::BattleImageAnalyzer::oper_cooling_analyze(const Rect& roi)
 {
     const auto cooling_task_ptr = Task.get<MatchTaskInfo>("BattleOperCooling");
 
-    auto img_roi = m_image(make_rect<cv::Rect>(roi));
-    cv::Mat hsv;
-    cv::cvtColor(img_roi, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv(roi);
     int h_low = cooling_task_ptr->mask_range.first;
     int h_up = cooling_task_ptr->mask_range.second;
     int s_low = cooling_task_ptr->specific_rect.x;
@@ -262,11 +261,11 @@ int asst::BattleImageAnalyzer::oper_cost_analyze(const Rect& roi)
         auto [v_l, v_u] = std::dynamic_pointer_cast<HashTaskInfo>(Task.get("BattleOperCostChannelV"))->mask_range;
         range_lower = cv::Scalar(h_l, s_l, v_l);
         range_upper = cv::Scalar(h_u, s_u, v_u);
-        std::unordered_map<std::string, std::string> num_hashs;
+        std::vector<std::pair<std::string, ImageHash>> num_hashs;
         for (auto&& num : NumName) {
-            auto hashs_vec = std::dynamic_pointer_cast<HashTaskInfo>(Task.get("BattleOperCost" + num))->hashes;
+            const auto& hashs_vec = std::dynamic_pointer_cast<HashTaskInfo>(Task.get("BattleOperCost" + num))->hashes;
             for (size_t i = 0; i != hashs_vec.size(); ++i) {
-                num_hashs.emplace(num + "_" + std::to_string(i), hashs_vec.at(i));
+                num_hashs.emplace_back(num + "_" + std::to_string(i), hashs_vec.at(i));
             }
         }
         hash_analyzer.set_hash_templates(std::move(num_hashs));
@@ -275,8 +274,7 @@ int asst::BattleImageAnalyzer::oper_cost_analyze(const Rect& roi)
         inited = true;
     }
 
-    cv::Mat hsv;
-    cv::cvtColor(m_image(make_rect<cv::Rect>(roi)), hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv(roi);
     cv::Mat bin;
     cv::inRange(hsv, range_lower, range_upper, bin);
     hash_analyzer.set_image(bin);
@@ -301,8 +299,7 @@ int asst::BattleImageAnalyzer::oper_cost_analyze(const Rect& roi)
 
 bool asst::BattleImageAnalyzer::oper_available_analyze(const Rect& roi)
 {
-    cv::Mat hsv;
-    cv::cvtColor(m_image(make_rect<cv::Rect>(roi)), hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv(roi);
     cv::Scalar avg = cv::mean(hsv);
     Log.trace("oper available, mean", avg[2]);
 
@@ -316,8 +313,7 @@ bool asst::BattleImageAnalyzer::oper_available_analyze(const Rect& roi)
 bool asst::BattleImageAnalyzer::home_analyze()
 {
     // 颜色转换
-    cv::Mat hsv;
-    cv::cvtColor(m_image, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv();
     cv::Mat bin;
     cv::inRange(hsv, cv::Scalar(104, 160, 180), cv::Scalar(107, 220, 255), bin);
 
@@ -386,7 +382,6 @@ bool asst::BattleImageAnalyzer::hp_analyze()
         }
     }
     Rect roi_rect = flag_analyzer.get_result().rect.move(flag_task_ptr->rect_move);
-    cv::Mat roi = m_image(make_rect<cv::Rect>(roi_rect));
 
     static const std::array<std::string, 10> NumName = { "0", "1", "2", "3", "4", "5", "6", "7", "8", "9" };
     static bool inited = false;
@@ -398,11 +393,11 @@ bool asst::BattleImageAnalyzer::hp_analyze()
         auto [v_l, v_u] = std::dynamic_pointer_cast<HashTaskInfo>(Task.get("BattleHpChannelV"))->mask_range;
         range_lower = cv::Scalar(h_l, s_l, v_l);
         range_upper = cv::Scalar(h_u, s_u, v_u);
-        std::unordered_map<std::string, std::string> num_hashs;
+        std::vector<std::pair<std::string, ImageHash>> num_hashs;
         for (auto&& num : NumName) {
             const auto& hashs_vec = std::dynamic_pointer_cast<HashTaskInfo>(Task.get("BattleHp" + num))->hashes;
             for (size_t i = 0; i != hashs_vec.size(); ++i) {
-                num_hashs.emplace(num + "_" + std::to_string(i), hashs_vec.at(i));
+                num_hashs.emplace_back(num + "_" + std::to_string(i), hashs_vec.at(i));
             }
         }
         hash_analyzer.set_hash_templates(std::move(num_hashs));
@@ -411,8 +406,7 @@ bool asst::BattleImageAnalyzer::hp_analyze()
         inited = true;
     }
 
-    cv::Mat hsv;
-    cv::cvtColor(roi, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv(roi_rect);
     cv::Mat bin;
     cv::inRange(hsv, range_lower, range_upper, bin);
     hash_analyzer.set_image(bin);
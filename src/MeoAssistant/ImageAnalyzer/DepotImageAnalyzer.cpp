@@ -1,9 +1,15 @@
 #include "DepotImageAnalyzer.h"
 
+#include <algorithm>
+#include <numeric>
+#include <span>
+
 #include "Utils/NoWarningCV.h"
 
-#include "General/MatchImageAnalyzer.h"
+#include "General/BatchMatchImageAnalyzer.h"
 #include "General/OcrWithPreprocessImageAnalyzer.h"
+#include "Resource/GeneralConfiger.h"
+#include "Resource/ItemIconIndex.h"
 #include "Resource/ItemConfiger.h"
 #include "TaskData.h"
 #include "Utils/Logger.hpp"
@@ -111,6 +117,9 @@ bool asst::DepotImageAnalyzer::analyze_all_items()
 {
     LogTraceFunction;
 
+    // 先把所有材料认出来，数量最后一起识别
+    std::vector<ItemInfo> infos;
+    std::vector<Rect> rois;
     for (const Rect& roi : m_all_items_roi) {
         if (check_roi_empty(roi)) { // roi 是竖着有序的
             break;
@@ -120,12 +129,24 @@ bool asst::DepotImageAnalyzer::analyze_all_items()
         if (cur_pos == NPos) {
             break;
         }
-        std::string item_id = info.item_id;
-
         m_match_begin_pos = cur_pos + 1;
-        info.quantity = match_quantity(info.rect);
-        info.item_name = ItemData.get_item_name(item_id);
+        info.item_name = ItemData.get_item_name(info.item_id);
+        infos.emplace_back(std::move(info));
+        rois.emplace_back(roi);
+    }
+
+    std::vector<Rect> item_rects;
+    for (const ItemInfo& info : infos) {
+        item_rects.emplace_back(info.rect);
+    }
+    std::vector<int> quantities = match_quantities(item_rects);
+
+    for (size_t i = 0; i != infos.size(); ++i) {
+        ItemInfo& info = infos[i];
+        std::string item_id = info.item_id;
+        info.quantity = quantities[i];
 #ifdef ASST_DEBUG
+        const Rect& roi = rois[i];
         cv::putText(m_image_draw_resized, item_id, cv::Point(roi.x, roi.y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.5,
                     cv::Scalar(0, 0, 255), 2);
         cv::putText(m_image_draw_resized, std::to_string(info.quantity), cv::Point(roi.x, roi.y + 10),
@@ -160,7 +181,7 @@ size_t asst::DepotImageAnalyzer::match_item(const Rect& roi, /* out */ ItemInfo&
 
     const auto& all_items = ItemData.get_ordered_material_item_id();
 
-    MatchImageAnalyzer analyzer(m_image_resized);
+    BatchMatchImageAnalyzer analyzer(m_image_resized);
     analyzer.set_task_info("DepotMatchData");
     // spacing 有时候算的差一个像素，干脆把 roi 扩大一点好了
     Rect enlarged_roi = roi;
@@ -169,27 +190,69 @@ size_t asst::DepotImageAnalyzer::match_item(const Rect& roi, /* out */ ItemInfo&
     }
     analyzer.set_roi(enlarged_roi);
 
+    // 匹配到了任一结果后，再往后匹配几个，取其中得分最高的。
+    // 因为有些相邻的材料长得很像（同一种类的）
+    constexpr size_t MaxExtraMatch = 8;
+    // 图标索引挑出的候选数，要足够覆盖上面那几个长得像的
+    constexpr size_t ShortlistSize = 16;
+    // 按顺序匹配时，一批匹配多少个材料
+    constexpr size_t BatchSize = 16;
+
     MatchRect matched;
     std::string matched_item_id;
     size_t matched_index = NPos;
-    for (size_t index = begin_index, extra_count = 0; index < all_items.size(); ++index) {
-        const std::string& item_id = all_items.at(index);
-        analyzer.set_templ_name(item_id);
-        if (!analyzer.analyze()) {
-            continue;
+    size_t matched_count = 0;
+    // indices 是 all_items 中的下标，从小到大排列
+    auto match_indices = [&](const std::vector<size_t>& indices) {
+        std::vector<std::string> templ_names;
+        templ_names.reserve(indices.size());
+        for (size_t index : indices) {
+            templ_names.emplace_back(all_items.at(index));
         }
-        if (double score = analyzer.get_result().score; score >= matched.score) {
-            matched = analyzer.get_result();
-            matched_item_id = item_id;
-            matched_index = index;
+        analyzer.set_templ_names(std::move(templ_names));
+        analyzer.analyze();
+
+        auto results = analyzer.get_result();
+        std::ranges::sort(results, std::less {}, &BatchMatchImageAnalyzer::Result::index);
+        for (const auto& result : results) {
+            if (result.match.score >= matched.score) {
+                matched = result.match;
+                matched_item_id = result.templ_name;
+                matched_index = indices.at(result.index);
+            }
+            if (++matched_count >= MaxExtraMatch) {
+                break;
+            }
         }
-        // 匹配到了任一结果后，再往后匹配几个。
-        // 因为有些相邻的材料长得很像（同一种类的）
-        constexpr size_t MaxExtraMatch = 8;
-        if (matched_index != NPos && ++extra_count >= MaxExtraMatch) {
-            break;
+    };
+
+    // 先用图标索引挑出候选，得到大概的位置，后面按顺序匹配到这里就可以停了，不用把剩下的材料都试一遍
+    size_t scan_end = all_items.size();
+    if (begin_index < all_items.size()) {
+        auto remaining = std::span(all_items).subspan(begin_index);
+        std::vector<size_t> candidates =
+            ItemIconIndex::get_instance().shortlist(m_image_resized, enlarged_roi, remaining, ShortlistSize);
+        std::ranges::for_each(candidates, [&](size_t& index) { index += begin_index; });
+        match_indices(candidates);
+        if (matched_index != NPos) {
+            scan_end = matched_index + 1;
         }
     }
+
+    // 候选里得分最高的不一定对：索引可能漏掉了按顺序第一个匹配上的材料，选中后面一个长得像的，
+    // m_match_begin_pos 就会跳过中间的材料，之后的格子全都认错。
+    // 所以还是从 begin_index 开始按顺序匹配，和逐个匹配时比较的范围一致（第一个匹配上的和之后的几个），
+    // 只是最多到候选的位置为止；候选不在这个范围内时，结果就是范围内得分最高的
+    matched = MatchRect();
+    matched_item_id.clear();
+    matched_index = NPos;
+    matched_count = 0;
+    for (size_t batch_begin = begin_index; batch_begin < scan_end && matched_count < MaxExtraMatch;
+         batch_begin += BatchSize) {
+        std::vector<size_t> batch((std::min)(BatchSize, scan_end - batch_begin));
+        std::iota(batch.begin(), batch.end(), batch_begin);
+        match_indices(batch);
+    }
     Log.info("Item id:", matched_item_id);
     if (matched_item_id.empty()) {
         return NPos;
@@ -199,7 +262,7 @@ size_t asst::DepotImageAnalyzer::match_item(const Rect& roi, /* out */ ItemInfo&
     return matched_index;
 }
 
-int asst::DepotImageAnalyzer::match_quantity(const Rect& roi)
+asst::Rect asst::DepotImageAnalyzer::match_quantity_roi(const Rect& roi)
 {
     auto task_ptr = Task.get<MatchTaskInfo>("DepotQuantity");
 
@@ -276,26 +339,58 @@ int asst::DepotImageAnalyzer::match_quantity(const Rect& roi)
         }
     }
     if (contours.empty()) {
-        return 0;
+        return {};
     }
     int far_left = contours.back().start;
     int far_right = contours.front().end;
 
+    return Rect(quantity_roi.x + far_left, quantity_roi.y + y_bounding_rect.y, far_right - far_left,
+                y_bounding_rect.height);
+}
+
+std::vector<int> asst::DepotImageAnalyzer::match_quantities(const std::vector<Rect>& item_rects)
+{
+    LogTraceFunction;
+
+    auto task_ptr = Task.get<MatchTaskInfo>("DepotQuantity");
+
+    std::vector<int> quantities(item_rects.size(), 0);
+    std::vector<size_t> indices;
+    std::vector<Rect> ocr_rois;
+    for (size_t i = 0; i != item_rects.size(); ++i) {
+        Rect ocr_roi = match_quantity_roi(item_rects[i]);
+        if (ocr_roi.empty()) {
+            continue;
+        }
+        indices.emplace_back(i);
+        ocr_rois.emplace_back(ocr_roi);
+    }
+    if (ocr_rois.empty()) {
+        return quantities;
+    }
+
+    // 所有数量一起交给 analyzer，开了 ocrBatch 时一次识别完
     OcrWithPreprocessImageAnalyzer analyzer(m_image_resized);
     analyzer.set_task_info("NumberOcrReplace");
-    Rect ocr_roi(quantity_roi.x + far_left, quantity_roi.y + y_bounding_rect.y, far_right - far_left,
-                 y_bounding_rect.height);
-    analyzer.set_roi(ocr_roi);
+    analyzer.set_batch_rois(std::move(ocr_rois));
+    analyzer.set_use_batch_ocr(m_use_batch_ocr.value_or(Configer.get_options().ocr_batch));
     analyzer.set_expansion(1);
     analyzer.set_threshold(task_ptr->mask_range.first, task_ptr->mask_range.second);
     analyzer.set_use_char_model(true);
+    analyzer.analyze();
 
-    if (!analyzer.analyze()) {
-        return 0;
+    const auto& batch_result = analyzer.get_batch_result();
+    for (size_t i = 0; i != batch_result.size(); ++i) {
+        if (batch_result[i].empty()) {
+            continue;
+        }
+        quantities[indices[i]] = parse_quantity(batch_result[i].front());
     }
+    return quantities;
+}
 
-    const auto& result = analyzer.get_result().front();
-
+int asst::DepotImageAnalyzer::parse_quantity(const TextRect& result)
+{
 #ifdef ASST_DEBUG
     cv::rectangle(m_image_draw_resized, make_rect<cv::Rect>(result.rect), cv::Scalar(0, 0, 255));
     cv::putText(m_image_draw_resized, result.text, cv::Point(result.rect.x, result.rect.y - 5),
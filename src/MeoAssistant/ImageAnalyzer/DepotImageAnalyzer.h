@@ -1,6 +1,8 @@
 #pragma once
 #include "General/AbstractImageAnalyzer.h"
 
+#include <optional>
+
 namespace asst
 {
     struct ItemInfo
@@ -24,6 +26,8 @@ namespace asst
         void set_match_begin_pos(size_t pos) noexcept;
         size_t get_match_begin_pos() const noexcept;
         const auto& get_result() const noexcept { return m_result; }
+        // 数量是否拼成一张图一次识别，不设置时见 config.json 的 ocrBatch
+        void set_use_batch_ocr(bool use_batch_ocr) noexcept { m_use_batch_ocr = use_batch_ocr; }
 
     private:
         void resize();
@@ -33,7 +37,11 @@ namespace asst
         bool check_roi_empty(const Rect& roi);
         size_t match_item(const Rect& roi, /* out */ ItemInfo& item_info, size_t begin_index = 0ULL,
                           bool with_enlarge = true);
-        int match_quantity(const Rect& roi);
+        // 数量文字所在的区域，没有数字时返回空的
+        Rect match_quantity_roi(const Rect& roi);
+        // 一次识别所有材料的数量，与 item_rects 一一对应，识别失败的为 0
+        std::vector<int> match_quantities(const std::vector<Rect>& item_rects);
+        int parse_quantity(const TextRect& result);
         Rect resize_rect_to_raw_size(const Rect& rect);
 
         size_t m_match_begin_pos = 0ULL;
@@ -44,5 +52,6 @@ namespace asst
 #endif
         std::vector<Rect> m_all_items_roi;
         std::unordered_map<std::string, ItemInfo> m_result;
+        std::optional<bool> m_use_batch_ocr;
     };
 }
@@ -3,6 +3,7 @@
 #include "Utils/NoWarningCV.h"
 
 #include "Controller.h"
+#include "FrameContext.h"
 #include "Utils/AsstImageIo.hpp"
 #include "Utils/Logger.hpp"
 #include "Utils/StringMisc.hpp"
@@ -27,6 +28,7 @@ asst::AbstractImageAnalyzer::AbstractImageAnalyzer(const cv::Mat& image, const R
 void asst::AbstractImageAnalyzer::set_image(const cv::Mat image)
 {
     m_image = image;
+    m_frame = nullptr;
 #ifdef ASST_DEBUG
     m_image_draw = image.clone();
 #endif
@@ -37,6 +39,14 @@ void asst::AbstractImageAnalyzer::set_roi(const Rect& roi) noexcept
     m_roi = correct_rect(roi, m_image);
 }
 
+asst::FrameContext& asst::AbstractImageAnalyzer::frame()
+{
+    if (m_frame == nullptr) {
+        m_frame = FrameContext::of(m_image);
+    }
+    return *m_frame;
+}
+
 asst::Rect asst::AbstractImageAnalyzer::correct_rect(const Rect& rect, const cv::Mat& image) noexcept
 {
     if (image.empty()) {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+
 #include "Utils/AsstTypes.h"
 #include "Utils/NoWarningCVMat.h"
 
@@ -10,6 +12,7 @@
 namespace asst
 {
     class TaskData;
+    class FrameContext;
     class AbstractImageAnalyzer
     {
     public:
@@ -32,9 +35,12 @@ namespace asst
 
     protected:
         static Rect correct_rect(const Rect& rect, const cv::Mat& image) noexcept;
+        // 当前图像的灰度图、HSV 图等，与同一张图上的其他分析器共用
+        FrameContext& frame();
 
         cv::Mat m_image;
         Rect m_roi;
+        std::shared_ptr<FrameContext> m_frame; // 第一次调用 frame() 时获取
 
 #ifdef ASST_DEBUG
         cv::Mat m_image_draw;
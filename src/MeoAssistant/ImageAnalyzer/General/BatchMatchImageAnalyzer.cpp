@@ -0,0 +1,119 @@
+#include "BatchMatchImageAnalyzer.h"
+
+#include <algorithm>
+
+#include "Utils/NoWarningCV.h"
+
+#include "Resource/TemplResource.h"
+#include "TaskData.h"
+#include "Utils/Logger.hpp"
+
+bool asst::BatchMatchImageAnalyzer::analyze()
+{
+    m_result.clear();
+    if (m_templ_names.empty()) {
+        return false;
+    }
+
+    m_roi = correct_rect(m_roi, m_image);
+    // matchTemplate 内部会把 8 位的图转成浮点再计算，所有模板共用同一个区域，这里提前转换一次
+    cv::Mat image_roi;
+    m_image(make_rect<cv::Rect>(m_roi)).convertTo(image_roi, CV_32F);
+
+    std::vector<std::optional<MatchRect>> matched(m_templ_names.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(m_templ_names.size())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            matched[i] = match_templ(image_roi, m_templ_names[i]);
+        }
+    });
+
+    for (size_t i = 0; i < matched.size(); ++i) {
+        if (matched[i]) {
+            m_result.emplace_back(Result { i, m_templ_names[i], matched[i].value() });
+        }
+    }
+    std::ranges::sort(m_result, [](const Result& lhs, const Result& rhs) {
+        return lhs.match.score != rhs.match.score ? lhs.match.score > rhs.match.score : lhs.index < rhs.index;
+    });
+    if (m_top_k != 0 && m_result.size() > m_top_k) {
+        m_result.resize(m_top_k);
+    }
+
+    if (!m_result.empty()) {
+        Log.trace("batch_match |", m_templ_names.size(), "templs,", m_result.size(), "matched, best:",
+                  m_result.front().templ_name, "score:", m_result.front().match.score, "roi:", m_roi);
+    }
+    return !m_result.empty();
+}
+
+void asst::BatchMatchImageAnalyzer::set_templ_names(std::vector<std::string> templ_names) noexcept
+{
+    m_templ_names = std::move(templ_names);
+}
+
+void asst::BatchMatchImageAnalyzer::set_task_info(const std::string& task_name)
+{
+    auto task_ptr = Task.get<MatchTaskInfo>(task_name);
+    m_templ_thres = task_ptr->templ_threshold;
+    m_mask_range = task_ptr->mask_range;
+    set_roi(task_ptr->roi);
+}
+
+void asst::BatchMatchImageAnalyzer::set_threshold(double templ_thres) noexcept
+{
+    m_templ_thres = templ_thres;
+}
+
+void asst::BatchMatchImageAnalyzer::set_mask_range(std::pair<int, int> mask_range) noexcept
+{
+    m_mask_range = std::move(mask_range);
+}
+
+void asst::BatchMatchImageAnalyzer::set_mask_with_close(bool with_close) noexcept
+{
+    m_mask_with_close = with_close;
+}
+
+void asst::BatchMatchImageAnalyzer::set_top_k(size_t k) noexcept
+{
+    m_top_k = k;
+}
+
+const std::vector<asst::BatchMatchImageAnalyzer::Result>& asst::BatchMatchImageAnalyzer::get_result() const noexcept
+{
+    return m_result;
+}
+
+std::optional<asst::MatchRect> asst::BatchMatchImageAnalyzer::match_templ(const cv::Mat& image_roi,
+                                                                          const std::string& templ_name) const
+{
+    auto& templ_res = TemplResource::get_instance();
+    const cv::Mat templ = templ_res.get_templ(templ_name);
+    if (templ.empty()) {
+        Log.error("templ is empty!", templ_name);
+        return std::nullopt;
+    }
+    if (templ.cols > image_roi.cols || templ.rows > image_roi.rows) {
+        Log.error("templ size is too large", templ_name, "image_roi size:", image_roi.cols, image_roi.rows,
+                  "templ size:", templ.cols, templ.rows);
+        return std::nullopt;
+    }
+
+    // 图和模板的类型必须一致
+    cv::Mat templ_f;
+    templ.convertTo(templ_f, CV_32F);
+    cv::Mat mask;
+    if (m_mask_range.first != 0 || m_mask_range.second != 0) {
+        mask = templ_res.get_templ_mask(templ_name, m_mask_range, m_mask_with_close);
+    }
+    cv::Mat matched;
+    cv::matchTemplate(image_roi, templ_f, matched, cv::TM_CCOEFF_NORMED, mask);
+
+    double max_val = 0.0;
+    cv::Point max_loc;
+    cv::minMaxLoc(matched, nullptr, &max_val, nullptr, &max_loc);
+    if (m_templ_thres <= max_val && max_val < 2.0) {
+        return MatchRect(max_val, Rect(max_loc.x + m_roi.x, max_loc.y + m_roi.y, templ.cols, templ.rows));
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "AbstractImageAnalyzer.h"
+
+#include <optional>
+#include <utility>
+
+namespace asst
+{
+    // 在同一个区域内一次匹配多个模板，例如识别材料图标时把所有材料的模板都试一遍
+    // 区域只预处理一次，各个模板的匹配分到多个线程上并行执行
+    class BatchMatchImageAnalyzer final : public AbstractImageAnalyzer
+    {
+    public:
+        struct Result
+        {
+            size_t index = 0; // 模板在 set_templ_names 传入的列表中的下标
+            std::string templ_name;
+            MatchRect match;
+        };
+
+        using AbstractImageAnalyzer::AbstractImageAnalyzer;
+        virtual ~BatchMatchImageAnalyzer() override = default;
+
+        virtual bool analyze() override;
+
+        void set_templ_names(std::vector<std::string> templ_names) noexcept;
+        // 使用任务的阈值、掩码范围和识别区域
+        void set_task_info(const std::string& task_name);
+        void set_threshold(double templ_thres) noexcept;
+        void set_mask_range(std::pair<int, int> mask_range) noexcept;
+        void set_mask_with_close(bool with_close) noexcept;
+        // 只保留得分最高的 k 个，为 0 时保留所有超过阈值的
+        void set_top_k(size_t k) noexcept;
+
+        // 按得分从高到低排序，得分相同的按下标从小到大排序
+        const std::vector<Result>& get_result() const noexcept;
+
+    private:
+        std::optional<MatchRect> match_templ(const cv::Mat& image_roi, const std::string& templ_name) const;
+
+        std::vector<std::string> m_templ_names;
+        double m_templ_thres = 0.0;
+        std::pair<int, int> m_mask_range;
+        bool m_mask_with_close = false;
+        size_t m_top_k = 0;
+        std::vector<Result> m_result;
+    };
+}
@@ -0,0 +1,98 @@
+#include "FrameContext.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "Utils/NoWarningCV.h"
+
+#include "Utils/Logger.hpp"
+
+asst::FrameContext::FrameContext(cv::Mat image) : m_image(std::move(image))
+{
+    m_gray.code = cv::COLOR_BGR2GRAY;
+    m_hsv.code = cv::COLOR_BGR2HSV;
+}
+
+std::shared_ptr<asst::FrameContext> asst::FrameContext::of(const cv::Mat& image)
+{
+    // 上下文持有图像，图像的内存在上下文释放前不会被复用，所以可以用地址来区分不同的图
+    static std::mutex registry_mutex;
+    static std::unordered_map<const uchar*, std::weak_ptr<FrameContext>> registry;
+
+    if (image.empty()) {
+        return std::make_shared<FrameContext>(image);
+    }
+
+    std::unique_lock<std::mutex> lock(registry_mutex);
+    if (auto iter = registry.find(image.data); iter != registry.cend()) {
+        if (auto context = iter->second.lock()) {
+            const cv::Mat& cached = context->m_image;
+            if (cached.size() == image.size() && cached.type() == image.type() && cached.step == image.step) {
+                return context;
+            }
+        }
+    }
+    std::erase_if(registry, [](const auto& pair) { return pair.second.expired(); });
+    auto context = std::make_shared<FrameContext>(image);
+    registry[image.data] = context;
+    return context;
+}
+
+cv::Mat asst::FrameContext::gray(const Rect& roi)
+{
+    return convert(m_gray, roi);
+}
+
+cv::Mat asst::FrameContext::hsv(const Rect& roi)
+{
+    return convert(m_hsv, roi);
+}
+
+cv::Mat asst::FrameContext::downscaled(int factor)
+{
+    if (factor <= 1) {
+        return m_image;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (auto iter = std::ranges::find(m_downscaled, factor, &std::pair<int, cv::Mat>::first);
+        iter != m_downscaled.cend()) {
+        return iter->second;
+    }
+    cv::Mat small;
+    cv::Size small_size((std::max)(m_image.cols / factor, 1), (std::max)(m_image.rows / factor, 1));
+    cv::resize(m_image, small, small_size, 0.0, 0.0, cv::INTER_AREA);
+    m_downscaled.emplace_back(factor, small);
+    return small;
+}
+
+cv::Mat asst::FrameContext::convert(Plane& plane, const Rect& roi)
+{
+    const cv::Rect full_rect(0, 0, m_image.cols, m_image.rows);
+    const cv::Rect rect = roi.empty() ? full_rect : (make_rect<cv::Rect>(roi) & full_rect);
+    if (rect.empty()) {
+        Log.error(__FUNCTION__, "roi is out of range", roi.to_string());
+        return {};
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!plane.full.empty()) {
+        return plane.full(rect);
+    }
+    if (auto iter = std::ranges::find(plane.rois, rect, &std::pair<cv::Rect, cv::Mat>::first);
+        iter != plane.rois.cend()) {
+        return iter->second;
+    }
+
+    const int64_t area = rect.area();
+    if (rect == full_rect || plane.converted_area + area > full_rect.area()) {
+        cv::cvtColor(m_image, plane.full, plane.code);
+        plane.rois.clear();
+        return plane.full(rect);
+    }
+    cv::Mat result;
+    cv::cvtColor(m_image(rect), result, plane.code);
+    plane.converted_area += area;
+    plane.rois.emplace_back(rect, result);
+    return result;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Utils/AsstTypes.h"
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 一帧截图的分析上下文，缓存灰度图、HSV 图、缩小的图等派生图像，同一帧上的多个分析器共用
+    // 派生图像都是第一次用到时才计算；返回的 Mat 与缓存共享内存，只能读，不能修改
+    class FrameContext
+    {
+    public:
+        explicit FrameContext(cv::Mat image);
+        FrameContext(const FrameContext&) = delete;
+        FrameContext(FrameContext&&) = delete;
+        ~FrameContext() = default;
+
+        // 同一张图（同一块内存、同样的尺寸）返回同一个上下文，只要还有人持有它
+        static std::shared_ptr<FrameContext> of(const cv::Mat& image);
+
+        const cv::Mat& image() const noexcept { return m_image; }
+        // roi 为空时返回整张图的
+        cv::Mat gray(const Rect& roi = Rect());
+        cv::Mat hsv(const Rect& roi = Rect());
+        // 整张图按 1/factor 缩小（INTER_AREA）
+        cv::Mat downscaled(int factor);
+
+        FrameContext& operator=(const FrameContext&) = delete;
+        FrameContext& operator=(FrameContext&&) = delete;
+
+    private:
+        // 一种颜色转换的结果。只用到几个小区域时只转换这些区域，
+        // 转换过的面积累计超过整张图时，直接转换整张图，之后的区域都从中截取
+        struct Plane
+        {
+            int code = 0; // cv::ColorConversionCodes
+            cv::Mat full;
+            std::vector<std::pair<cv::Rect, cv::Mat>> rois;
+            int64_t converted_area = 0;
+        };
+
+        cv::Mat convert(Plane& plane, const Rect& roi);
+
+        cv::Mat m_image;
+
+        std::mutex m_mutex;
+        Plane m_gray;
+        Plane m_hsv;
+        std::vector<std::pair<int, cv::Mat>> m_downscaled; // factor -> 缩小的图
+    };
+}
@@ -1,5 +1,7 @@
 #include "HashImageAnalyzer.h"
 
+#include <bit>
+
 #include "Utils/NoWarningCV.h"
 
 #include "Utils/Logger.hpp"
@@ -32,21 +34,21 @@ bool asst::HashImageAnalyzer::analyze()
         if (m_need_bound) {
             to_hash = bound_bin(to_hash);
         }
-        std::string hash_result = s_hash(to_hash);
-        // Log.debug(hash_result);
+        ImageHash hash_result = s_hash(to_hash);
 
         int min_dist = INT_MAX;
-        std::string cur_min_dist_name;
-        for (auto&& [name, templ] : m_hash_templates) {
-            int hm = hamming(hash_result, templ);
-            // Log.debug(name, "dist:", hm);
+        size_t min_dist_index = 0;
+        for (size_t i = 0; i < m_hash_templates.size(); ++i) {
+            int hm = hamming(hash_result, m_hash_templates[i]);
+            // Log.debug(m_hash_template_names[i], "dist:", hm);
             if (hm < min_dist) {
-                cur_min_dist_name = name;
+                min_dist_index = i;
                 min_dist = hm;
             }
         }
-        m_min_dist_name.emplace_back(std::move(cur_min_dist_name));
-        m_hash_result.emplace_back(std::move(hash_result));
+        m_min_dist_name.emplace_back(m_hash_templates.empty() ? std::string()
+                                                              : m_hash_template_names[min_dist_index]);
+        m_hash_result.emplace_back(hash_result);
     }
 
     return true;
@@ -62,9 +64,16 @@ void asst::HashImageAnalyzer::set_mask_range(std::pair<int, int> mask_range) noe
     m_mask_range = std::move(mask_range);
 }
 
-void asst::HashImageAnalyzer::set_hash_templates(std::unordered_map<std::string, std::string> hash_templates) noexcept
+void asst::HashImageAnalyzer::set_hash_templates(std::vector<std::pair<std::string, ImageHash>> hash_templates)
 {
-    m_hash_templates = std::move(hash_templates);
+    m_hash_templates.clear();
+    m_hash_template_names.clear();
+    m_hash_templates.reserve(hash_templates.size());
+    m_hash_template_names.reserve(hash_templates.size());
+    for (auto&& [name, hash] : hash_templates) {
+        m_hash_template_names.emplace_back(std::move(name));
+        m_hash_templates.emplace_back(hash);
+    }
 }
 
 void asst::HashImageAnalyzer::set_need_split(bool need_split) noexcept
@@ -82,14 +91,15 @@ const std::vector<std::string>& asst::HashImageAnalyzer::get_min_dist_name() con
     return m_min_dist_name;
 }
 
-const std::vector<std::string>& asst::HashImageAnalyzer::get_hash() const noexcept
+const std::vector<asst::ImageHash>& asst::HashImageAnalyzer::get_hash() const noexcept
 {
     return m_hash_result;
 }
 
-std::string asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
+asst::ImageHash asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
 {
     static constexpr int HashKernelSize = 16;
+    static_assert(HashKernelSize * HashKernelSize == sizeof(ImageHash) * 8);
     cv::Mat resized;
     cv::resize(img, resized, cv::Size(HashKernelSize, HashKernelSize));
     if (img.channels() == 3) {
@@ -97,19 +107,14 @@ std::string asst::HashImageAnalyzer::s_hash(const cv::Mat& img)
         cv::cvtColor(resized, temp, cv::COLOR_BGR2GRAY);
         resized = temp;
     }
-    std::stringstream hash_value;
-    uchar* pix = resized.data;
-    int tmp_dec = 0;
-    for (int ro = 0; ro < 256; ro++) {
-        tmp_dec = tmp_dec << 1;
-        if (*pix > 127) tmp_dec++;
-        if (ro % 4 == 3) {
-            hash_value << std::hex << tmp_dec;
-            tmp_dec = 0;
+    ImageHash hash_value {};
+    const uchar* pix = resized.ptr<uchar>();
+    for (int ro = 0; ro < HashKernelSize * HashKernelSize; ro++) {
+        if (pix[ro] > 127) {
+            hash_value[ro / 64] |= 1ULL << (63 - ro % 64);
         }
-        pix++;
     }
-    return hash_value.str();
+    return hash_value;
 }
 
 std::vector<cv::Mat> asst::HashImageAnalyzer::split_bin(const cv::Mat& bin)
@@ -152,20 +157,12 @@ cv::Mat asst::HashImageAnalyzer::bound_bin(const cv::Mat& bin)
     return bin(cv::boundingRect(bin));
 }
 
-int asst::HashImageAnalyzer::hamming(std::string hash1, std::string hash2)
+int asst::HashImageAnalyzer::hamming(const ImageHash& hash1, const ImageHash& hash2) noexcept
 {
-    static constexpr int HammingFlags = 64;
-
-    hash1.insert(hash1.begin(), HammingFlags - hash1.size(), '0');
-    hash2.insert(hash2.begin(), HammingFlags - hash2.size(), '0');
+    // std::popcount 在支持的 CPU 上会编译成 popcnt 指令
     int dist = 0;
-    for (int i = 0; i < HammingFlags; i = i + 16) {
-        unsigned long long x =
-            strtoull(hash1.substr(i, 16).c_str(), nullptr, 16) ^ strtoull(hash2.substr(i, 16).c_str(), nullptr, 16);
-        while (x) {
-            ++dist;
-            x = x & (x - 1);
-        }
+    for (size_t i = 0; i < hash1.size(); ++i) {
+        dist += std::popcount(hash1[i] ^ hash2[i]);
     }
     return dist;
 }
@@ -1,7 +1,7 @@
 #pragma once
 #include "AbstractImageAnalyzer.h"
 
-#include <unordered_map>
+#include <utility>
 
 namespace asst
 {
@@ -15,25 +15,27 @@ namespace asst
 
         void set_mask_range(int lower, int upper) noexcept;
         void set_mask_range(std::pair<int, int> mask_range) noexcept;
-        void set_hash_templates(std::unordered_map<std::string, std::string> hash_templates) noexcept;
+        void set_hash_templates(std::vector<std::pair<std::string, ImageHash>> hash_templates);
         void set_need_split(bool need_split) noexcept;
         void set_need_bound(bool need_bound) noexcept;
 
         const std::vector<std::string>& get_min_dist_name() const noexcept;
-        const std::vector<std::string>& get_hash() const noexcept;
+        const std::vector<ImageHash>& get_hash() const noexcept;
 
-        static std::string s_hash(const cv::Mat& img);
-        static int hamming(std::string hash1, std::string hash2);
+        static ImageHash s_hash(const cv::Mat& img);
+        static int hamming(const ImageHash& hash1, const ImageHash& hash2) noexcept;
         static std::vector<cv::Mat> split_bin(const cv::Mat& bin);
         static cv::Mat bound_bin(const cv::Mat& bin);
 
     protected:
         std::pair<int, int> m_mask_range;
-        std::unordered_map<std::string, std::string> m_hash_templates;
+        // 模板的哈希连续存放，逐个比较时不用跳来跳去
+        std::vector<ImageHash> m_hash_templates;
+        std::vector<std::string> m_hash_template_names;
         bool m_need_split = false;
         bool m_need_bound = false;
 
-        std::vector<std::string> m_hash_result;
+        std::vector<ImageHash> m_hash_result;
         std::vector<std::string> m_min_dist_name;
     };
 }
@@ -1,7 +1,10 @@
 #include "MatchImageAnalyzer.h"
 
+#include <tuple>
+
 #include "Utils/NoWarningCV.h"
 
+#include "FrameContext.h"
 #include "Resource/TemplResource.h"
 #include "TaskData.h"
 #include "Utils/Logger.hpp"
@@ -80,6 +83,11 @@ void asst::MatchImageAnalyzer::set_mask_with_close(int with_close) noexcept
     m_mask_with_close = with_close;
 }
 
+void asst::MatchImageAnalyzer::set_use_pyramid(bool use_pyramid) noexcept
+{
+    m_use_pyramid = use_pyramid;
+}
+
 const asst::MatchRect& asst::MatchImageAnalyzer::get_result() const noexcept
 {
     return m_result;
@@ -91,6 +99,7 @@ void asst::MatchImageAnalyzer::set_task_info(MatchTaskInfo task_info) noexcept
     m_templ_name = std::move(task_info.templ_name);
     m_templ_thres = task_info.templ_threshold;
     m_use_cache = task_info.cache;
+    m_use_pyramid = task_info.pyramid;
 
     if (m_use_cache && !m_region_of_appeared.empty()) {
         m_roi = m_region_of_appeared;
@@ -109,23 +118,30 @@ bool asst::MatchImageAnalyzer::match_templ(const cv::Mat templ)
         return false;
     }
 
-    cv::Mat matched;
-    if (m_mask_range.first == 0 && m_mask_range.second == 0) {
-        cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED);
+    cv::Mat mask;
+    if (m_mask_range.first != 0 || m_mask_range.second != 0) {
+        // 资源中的模板，掩码只在第一次用到时生成
+        mask = m_templ_name.empty()
+                   ? TemplResource::make_mask(templ, m_mask_range, m_mask_with_close)
+                   : TemplResource::get_instance().get_templ_mask(m_templ_name, m_mask_range, m_mask_with_close);
+    }
+
+    double max_val = 0.0;
+    cv::Point max_loc;
+    std::optional<std::pair<double, cv::Point>> pyramid_result;
+    if (m_use_pyramid) {
+        pyramid_result = pyramid_match(templ, mask);
+    }
+    if (pyramid_result) {
+        std::tie(max_val, max_loc) = pyramid_result.value();
     }
     else {
-        cv::Mat mask;
-        cv::cvtColor(templ, mask, cv::COLOR_BGR2GRAY);
-        cv::inRange(mask, m_mask_range.first, m_mask_range.second, mask);
-        if (m_mask_with_close) {
-            cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-            cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
-        }
+        cv::Mat matched;
         cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED, mask);
+        double min_val = 0.0;
+        cv::Point min_loc;
+        cv::minMaxLoc(matched, &min_val, &max_val, &min_loc, &max_loc);
     }
-    double min_val = 0.0, max_val = 0.0;
-    cv::Point min_loc, max_loc;
-    cv::minMaxLoc(matched, &min_val, &max_val, &min_loc, &max_loc);
 
     Rect rect(max_loc.x + m_roi.x, max_loc.y + m_roi.y, templ.cols, templ.rows);
     if (max_val > 2.0) {
@@ -143,3 +159,77 @@ bool asst::MatchImageAnalyzer::match_templ(const cv::Mat templ)
         return false;
     }
 }
+
+std::optional<std::pair<double, cv::Point>> asst::MatchImageAnalyzer::pyramid_match(const cv::Mat& templ,
+                                                                                   const cv::Mat& mask)
+{
+    static constexpr int Factor = 2;              // 粗匹配时缩小的倍数
+    static constexpr int MinSmallTemplSize = 8;   // 缩小后的模板太小，粗匹配的得分就不可靠了
+    static constexpr int MaxCandidates = 3;       // 最多精确匹配几个候选位置
+    static constexpr double CandidateRatio = 0.7; // 粗匹配得分不低于阈值的多少倍才算候选
+    static constexpr int RefineMargin = 2;        // 精确匹配时在候选位置周围多搜索的像素
+
+    const cv::Size small_templ_size(templ.cols / Factor, templ.rows / Factor);
+    if (small_templ_size.width < MinSmallTemplSize || small_templ_size.height < MinSmallTemplSize) {
+        return std::nullopt;
+    }
+    // 识别区域和模板差不多大时，直接匹配就很快
+    if (m_roi.width < templ.cols * 2 && m_roi.height < templ.rows * 2) {
+        return std::nullopt;
+    }
+
+    const cv::Mat small_image = frame().downscaled(Factor);
+    const cv::Rect small_roi = cv::Rect(m_roi.x / Factor, m_roi.y / Factor, m_roi.width / Factor,
+                                        m_roi.height / Factor) &
+                               cv::Rect(0, 0, small_image.cols, small_image.rows);
+    if (small_roi.width < small_templ_size.width || small_roi.height < small_templ_size.height) {
+        return std::nullopt;
+    }
+    cv::Mat small_templ;
+    cv::resize(templ, small_templ, small_templ_size, 0.0, 0.0, cv::INTER_AREA);
+    cv::Mat small_mask;
+    if (!mask.empty()) {
+        cv::resize(mask, small_mask, small_templ_size, 0.0, 0.0, cv::INTER_NEAREST);
+    }
+
+    cv::Mat coarse;
+    cv::matchTemplate(small_image(small_roi), small_templ, coarse, cv::TM_CCOEFF_NORMED, small_mask);
+    // 带掩码时纯色区域的得分可能是 nan 或者很大的数，和直接匹配时一样当作 0
+    cv::patchNaNs(coarse, 0.0);
+    cv::threshold(coarse, coarse, 2.0, 0.0, cv::THRESH_TOZERO_INV);
+
+    const cv::Rect full_roi = make_rect<cv::Rect>(m_roi);
+    double best_val = 0.0;
+    cv::Point best_loc;
+    for (int i = 0; i < MaxCandidates; ++i) {
+        double coarse_val = 0.0;
+        cv::Point coarse_loc;
+        cv::minMaxLoc(coarse, nullptr, &coarse_val, nullptr, &coarse_loc);
+        if (coarse_val < m_templ_thres * CandidateRatio) {
+            break;
+        }
+        // 同一个目标附近的点得分都很高，取过之后整块抹掉，下一个候选就是别的位置了
+        cv::Rect suppressed(coarse_loc.x - small_templ_size.width / 2, coarse_loc.y - small_templ_size.height / 2,
+                            small_templ_size.width, small_templ_size.height);
+        coarse(suppressed & cv::Rect(0, 0, coarse.cols, coarse.rows)).setTo(0.0);
+
+        const int pad = Factor + RefineMargin;
+        cv::Rect window((small_roi.x + coarse_loc.x) * Factor - pad, (small_roi.y + coarse_loc.y) * Factor - pad,
+                        templ.cols + pad * 2, templ.rows + pad * 2);
+        window &= full_roi;
+        if (window.width < templ.cols || window.height < templ.rows) {
+            continue;
+        }
+        cv::Mat refined;
+        cv::matchTemplate(m_image(window), templ, refined, cv::TM_CCOEFF_NORMED, mask);
+        cv::patchNaNs(refined, 0.0);
+        double refined_val = 0.0;
+        cv::Point refined_loc;
+        cv::minMaxLoc(refined, nullptr, &refined_val, nullptr, &refined_loc);
+        if (refined_val > best_val && refined_val < 2.0) {
+            best_val = refined_val;
+            best_loc = refined_loc + window.tl() - full_roi.tl();
+        }
+    }
+    return std::make_pair(best_val, best_loc);
+}
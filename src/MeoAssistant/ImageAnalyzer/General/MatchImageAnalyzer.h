@@ -1,6 +1,9 @@
 #pragma once
 #include "AbstractImageAnalyzer.h"
 
+#include <optional>
+#include <utility>
+
 namespace asst
 {
     class MatchImageAnalyzer : public AbstractImageAnalyzer
@@ -22,12 +25,16 @@ namespace asst
         void set_task_info(const std::string& task_name);
         void set_region_of_appeared(Rect region) noexcept;
         void set_mask_with_close(int with_close) noexcept;
+        // 先在缩小的图上粗匹配找出候选位置，再在原图上只匹配候选位置附近，识别区域远大于模板时快很多
+        void set_use_pyramid(bool use_pyramid) noexcept;
 
         const MatchRect& get_result() const noexcept;
 
     protected:
         virtual bool match_templ(const cv::Mat templ);
         void set_task_info(MatchTaskInfo task_info) noexcept;
+        // 返回的位置相对于 m_roi；不适合用金字塔匹配（识别区域太小、模板太小）时返回 std::nullopt
+        std::optional<std::pair<double, cv::Point>> pyramid_match(const cv::Mat& templ, const cv::Mat& mask);
 
         std::string m_templ_name;
         cv::Mat m_templ;
@@ -37,5 +44,6 @@ namespace asst
         Rect m_region_of_appeared;
         std::pair<int, int> m_mask_range;
         bool m_mask_with_close = false;
+        bool m_use_pyramid = false;
     };
 }
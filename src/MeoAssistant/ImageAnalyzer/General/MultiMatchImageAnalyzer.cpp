@@ -115,10 +115,9 @@ bool asst::MultiMatchImageAnalyzer::multi_match_templ(const cv::Mat templ)
         cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED);
     }
     else {
-        cv::Mat mask;
-        cv::cvtColor(templ, mask, cv::COLOR_BGR2GRAY);
-        // cv::threshold(mask, mask, m_mask_range.first, 255, cv::THRESH_BINARY);
-        cv::inRange(mask, m_mask_range.first, m_mask_range.second, mask);
+        const cv::Mat mask = m_templ_name.empty()
+                                 ? TemplResource::make_mask(templ, m_mask_range, false)
+                                 : TemplResource::get_instance().get_templ_mask(m_templ_name, m_mask_range, false);
         cv::matchTemplate(image_roi, templ, matched, cv::TM_CCOEFF_NORMED, mask);
     }
 
@@ -1,11 +1,9 @@
 #include "OcrImageAnalyzer.h"
 
-#include <regex>
-#include <unordered_map>
-
 #include "Resource/OcrPack.h"
 #include "TaskData.h"
 #include "Utils/Logger.hpp"
+#include "Utils/TextReplacer.h"
 
 bool asst::OcrImageAnalyzer::analyze()
 {
@@ -13,13 +11,21 @@ bool asst::OcrImageAnalyzer::analyze()
 
     m_ocr_result.clear();
 
+    m_roi = correct_rect(m_roi, m_image);
+
+    m_ocr_result = ocr_pack().recognize(m_image, m_roi, make_pred(), m_without_det);
+
+    // log.trace("ocr result", m_ocr_result);
+    return !m_ocr_result.empty();
+}
+
+asst::TextRectProc asst::OcrImageAnalyzer::make_pred()
+{
     std::vector<TextRectProc> preds_vec;
 
-    if (!m_replace.empty()) {
-        TextRectProc text_replace = [&](TextRect& tr) -> bool {
-            for (const auto& [regex, new_str] : m_replace) {
-                tr.text = std::regex_replace(tr.text, std::regex(regex), new_str);
-            }
+    if (m_replace && !m_replace->empty()) {
+        TextRectProc text_replace = [replace = m_replace](TextRect& tr) -> bool {
+            replace->apply(tr.text);
             return true;
         };
         preds_vec.emplace_back(text_replace);
@@ -27,13 +33,13 @@ bool asst::OcrImageAnalyzer::analyze()
 
     if (!m_required.empty()) {
         if (m_full_match) {
-            TextRectProc required_match = [&](TextRect& tr) -> bool {
+            TextRectProc required_match = [this](TextRect& tr) -> bool {
                 return ranges::find(m_required, tr.text) != m_required.cend();
             };
             preds_vec.emplace_back(required_match);
         }
         else {
-            TextRectProc required_search = [&](TextRect& tr) -> bool {
+            TextRectProc required_search = [this](TextRect& tr) -> bool {
                 auto is_sub = [&tr](const std::string& str) -> bool {
                     if (tr.text.find(str) == std::string::npos) {
                         return false;
@@ -49,7 +55,7 @@ bool asst::OcrImageAnalyzer::analyze()
 
     preds_vec.emplace_back(m_pred);
 
-    TextRectProc all_pred = [&](TextRect& tr) -> bool {
+    return [preds_vec = std::move(preds_vec)](TextRect& tr) -> bool {
         for (const auto& pred : preds_vec) {
             if (pred && !pred(tr)) {
                 return false;
@@ -57,21 +63,14 @@ bool asst::OcrImageAnalyzer::analyze()
         }
         return true;
     };
+}
 
-    m_roi = correct_rect(m_roi, m_image);
-
-    OcrPack* ocr_ptr = nullptr;
+asst::OcrPack& asst::OcrImageAnalyzer::ocr_pack() const
+{
     if (m_use_char_model) {
-        ocr_ptr = &CharOcr::get_instance();
+        return CharOcr::get_instance();
     }
-    else {
-        ocr_ptr = &WordOcr::get_instance();
-    }
-    m_ocr_result = ocr_ptr->recognize(m_image, m_roi, all_pred, m_without_det);
-    ocr_ptr = nullptr;
-
-    // log.trace("ocr result", m_ocr_result);
-    return !m_ocr_result.empty();
+    return WordOcr::get_instance();
 }
 
 void asst::OcrImageAnalyzer::filter(const TextRectProc& filter_func)
@@ -96,7 +95,7 @@ void asst::OcrImageAnalyzer::set_required(std::vector<std::string> required) noe
     m_required = std::move(required);
 }
 
-void asst::OcrImageAnalyzer::set_replace(std::unordered_map<std::string, std::string> replace) noexcept
+void asst::OcrImageAnalyzer::set_replace(std::shared_ptr<const TextReplacer> replace) noexcept
 {
     m_replace = std::move(replace);
 }
@@ -2,13 +2,16 @@
 #include "AbstractImageAnalyzer.h"
 
 #include <functional>
-#include <unordered_map>
+#include <memory>
 #include <vector>
 
 #include "Utils/AsstTypes.h"
 
 namespace asst
 {
+    class OcrPack;
+    class TextReplacer;
+
     class OcrImageAnalyzer : public AbstractImageAnalyzer
     {
     public:
@@ -25,7 +28,8 @@ namespace asst
         virtual void sort_result_by_required(); // 按传入的需求数组排序，传入的在前面结果接在前面
 
         void set_required(std::vector<std::string> required) noexcept;
-        void set_replace(std::unordered_map<std::string, std::string> replace) noexcept;
+        // 传入 OcrTaskInfo::replace_map，规则在解析任务时就已经编译好
+        void set_replace(std::shared_ptr<const TextReplacer> replace) noexcept;
 
         virtual void set_task_info(std::shared_ptr<TaskInfo> task_ptr);
         virtual void set_task_info(const std::string& task_name);
@@ -40,11 +44,14 @@ namespace asst
 
     protected:
         virtual void set_task_info(OcrTaskInfo task_info) noexcept;
+        // 把 replace、required 和 set_pred 设置的过滤条件合成一个，返回的函数引用了 this，只能在分析时用
+        TextRectProc make_pred();
+        OcrPack& ocr_pack() const;
 
         std::vector<TextRect> m_ocr_result;
         std::vector<std::string> m_required;
         bool m_full_match = false;
-        std::unordered_map<std::string, std::string> m_replace;
+        std::shared_ptr<const TextReplacer> m_replace;
         TextRectProc m_pred = nullptr;
         bool m_without_det = false;
         bool m_use_cache = false;
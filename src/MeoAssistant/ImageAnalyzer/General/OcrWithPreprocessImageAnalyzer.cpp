@@ -2,25 +2,77 @@
 
 #include "Utils/NoWarningCV.h"
 
+#include "FrameContext.h"
+#include "Resource/OcrPack.h"
+
 bool asst::OcrWithPreprocessImageAnalyzer::analyze()
 {
     m_without_det = true;
 
-    m_roi = correct_rect(m_roi, m_image);
-    cv::Mat img_roi = m_image(make_rect<cv::Rect>(m_roi));
-    cv::Mat img_roi_gray;
-    cv::cvtColor(img_roi, img_roi_gray, cv::COLOR_BGR2GRAY);
+    if (!m_batch_rois.empty()) {
+        return analyze_batch();
+    }
+
+    Rect new_roi = preprocess_roi(m_roi);
+    if (new_roi.empty()) {
+        return false;
+    }
+    // todo: split
+
+    OcrImageAnalyzer::set_roi(new_roi);
+    return OcrImageAnalyzer::analyze();
+}
+
+bool asst::OcrWithPreprocessImageAnalyzer::analyze_batch()
+{
+    m_ocr_result.clear();
+    m_batch_result.assign(m_batch_rois.size(), {});
+
+    std::vector<size_t> indices;
+    std::vector<Rect> ocr_rois;
+    for (size_t i = 0; i != m_batch_rois.size(); ++i) {
+        Rect new_roi = preprocess_roi(m_batch_rois[i]);
+        if (new_roi.empty()) {
+            continue;
+        }
+        indices.emplace_back(i);
+        ocr_rois.emplace_back(correct_rect(new_roi, m_image));
+    }
+    if (ocr_rois.empty()) {
+        return false;
+    }
+
+    std::vector<std::vector<TextRect>> results;
+    if (m_use_batch_ocr) {
+        results = ocr_pack().recognize_batch(m_image, ocr_rois, make_pred());
+    }
+    else {
+        auto pred = make_pred();
+        for (const Rect& roi : ocr_rois) {
+            results.emplace_back(ocr_pack().recognize(m_image, roi, pred, true));
+        }
+    }
+    for (size_t i = 0; i != results.size(); ++i) {
+        m_ocr_result.insert(m_ocr_result.end(), results[i].cbegin(), results[i].cend());
+        m_batch_result[indices[i]] = std::move(results[i]);
+    }
+    return !m_ocr_result.empty();
+}
+
+asst::Rect asst::OcrWithPreprocessImageAnalyzer::preprocess_roi(const Rect& roi)
+{
+    Rect corrected = correct_rect(roi, m_image);
+    cv::Mat img_roi_gray = frame().gray(corrected);
     cv::Mat bin;
     cv::inRange(img_roi_gray, m_threshold_lower, m_threshold_upper, bin);
     cv::Rect bounding_rect = cv::boundingRect(bin);
-    bounding_rect.x += m_roi.x;
-    bounding_rect.y += m_roi.y;
+    bounding_rect.x += corrected.x;
+    bounding_rect.y += corrected.y;
     auto new_roi = make_rect<Rect>(bounding_rect);
 
     if (new_roi.empty()) {
-        return false;
+        return {};
     }
-    // todo: split
 
     if (m_expansion) {
         new_roi.x -= m_expansion;
@@ -28,12 +80,10 @@ bool asst::OcrWithPreprocessImageAnalyzer::analyze()
         new_roi.width += 2 * m_expansion;
         new_roi.height += 2 * m_expansion;
     }
-    OcrImageAnalyzer::set_roi(new_roi);
 #ifdef ASST_DEBUG
     cv::rectangle(m_image_draw, make_rect<cv::Rect>(new_roi), cv::Scalar(0, 0, 255), 1);
 #endif // ASST_DEBUG
-
-    return OcrImageAnalyzer::analyze();
+    return new_roi;
 }
 
 void asst::OcrWithPreprocessImageAnalyzer::set_threshold(int lower, int upper)
@@ -52,6 +102,21 @@ void asst::OcrWithPreprocessImageAnalyzer::set_expansion(int expansion)
     m_expansion = expansion;
 }
 
+void asst::OcrWithPreprocessImageAnalyzer::set_batch_rois(std::vector<Rect> rois)
+{
+    m_batch_rois = std::move(rois);
+}
+
+void asst::OcrWithPreprocessImageAnalyzer::set_use_batch_ocr(bool use_batch_ocr) noexcept
+{
+    m_use_batch_ocr = use_batch_ocr;
+}
+
+const std::vector<std::vector<asst::TextRect>>& asst::OcrWithPreprocessImageAnalyzer::get_batch_result() const noexcept
+{
+    return m_batch_result;
+}
+
 void asst::OcrWithPreprocessImageAnalyzer::set_task_info(std::shared_ptr<TaskInfo> task_ptr)
 {
     OcrImageAnalyzer::set_task_info(task_ptr);
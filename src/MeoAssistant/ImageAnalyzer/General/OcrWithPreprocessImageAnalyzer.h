@@ -14,17 +14,28 @@ namespace asst
         void set_threshold(int lower, int upper = 255);
         void set_split(bool split);
         void set_expansion(int expansion);
+        // 设置多个区域后，analyze 对每个区域分别做预处理，再逐个识别（use_batch_ocr 时一次性批量识别）
+        // 结果按区域分开存在 get_batch_result 里，与区域一一对应，识别不到的为空；get_result 为所有结果
+        void set_batch_rois(std::vector<Rect> rois);
+        void set_use_batch_ocr(bool use_batch_ocr) noexcept;
+        const std::vector<std::vector<TextRect>>& get_batch_result() const noexcept;
 
         virtual void set_task_info(std::shared_ptr<TaskInfo> task_ptr) override;
         virtual void set_task_info(const std::string& task_name) override;
 
     protected:
         virtual void set_task_info(OcrTaskInfo task_info) noexcept override;
+        bool analyze_batch();
+        // 二值化后取文字的外接矩形再向外扩展，没有文字时返回空的
+        Rect preprocess_roi(const Rect& roi);
 
         int m_threshold_lower = 140;
         int m_threshold_upper = 255;
         bool m_split = false;
         int m_expansion = 2;
+        std::vector<Rect> m_batch_rois;
+        bool m_use_batch_ocr = false;
+        std::vector<std::vector<TextRect>> m_batch_result;
 
     private:
         virtual void set_use_cache(bool is_use) noexcept override { std::ignore = is_use; }
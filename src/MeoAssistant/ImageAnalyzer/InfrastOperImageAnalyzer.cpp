@@ -3,6 +3,7 @@
 #include "Utils/AsstRanges.hpp"
 #include "Utils/NoWarningCV.h"
 
+#include "General/FrameContext.h"
 #include "General/HashImageAnalyzer.h"
 #include "General/MatchImageAnalyzer.h"
 #include "InfrastSmileyImageAnalyzer.h"
@@ -162,9 +163,7 @@ void asst::InfrastOperImageAnalyzer::mood_analyze()
         Rect roi = rect_move;
         roi.x += oper.smiley.rect.x;
         roi.y += oper.smiley.rect.y;
-        cv::Mat prg_image = m_image(make_rect<cv::Rect>(roi));
-        cv::Mat prg_gray;
-        cv::cvtColor(prg_image, prg_gray, cv::COLOR_BGR2GRAY);
+        cv::Mat prg_gray = frame().gray(roi);
 
         int max_white_length = 0; // 最长横扫的白色长度，即作为进度条长度
         for (int i = 0; i != prg_gray.rows; ++i) {
@@ -246,16 +245,14 @@ void asst::InfrastOperImageAnalyzer::skill_analyze()
             cv::circle(mask, cv::Point(radius, radius), radius, cv::Scalar(255, 255, 255), -1);
         }
 
-        cv::Mat all_skills_img = m_image(make_rect<cv::Rect>(roi));
+        cv::Mat all_skills_gray = frame().gray(roi);
         std::string log_str = "[ ";
         for (int i = 0; i != MaxNumOfSkills; ++i) {
             int x = i * skill_width + spacing * i;
             Rect skill_rect_in_roi(x, 0, skill_width, roi.height);
-            cv::Mat skill_image = all_skills_img(make_rect<cv::Rect>(skill_rect_in_roi));
 
             // 过滤掉亮度阈值不够的，说明是暗的技能（不是当前设施的技能）
-            cv::Mat skill_gray;
-            cv::cvtColor(skill_image, skill_gray, cv::COLOR_BGR2GRAY);
+            cv::Mat skill_gray = all_skills_gray(make_rect<cv::Rect>(skill_rect_in_roi));
             cv::Scalar avg = cv::mean(skill_gray, mask);
             if (avg[0] < bright_thres) {
                 continue;
@@ -352,9 +349,7 @@ void asst::InfrastOperImageAnalyzer::selected_analyze()
         selected_rect.x += oper.smiley.rect.x;
         selected_rect.y += oper.smiley.rect.y;
 
-        cv::Mat roi = m_image(make_rect<cv::Rect>(selected_rect));
-        cv::Mat hsv, bin;
-        cv::cvtColor(roi, hsv, cv::COLOR_BGR2HSV);
+        cv::Mat hsv = frame().hsv(selected_rect);
         std::vector<cv::Mat> channels;
         cv::split(hsv, channels);
         int mask_lowb = selected_task_ptr->mask_range.first;
@@ -1,12 +1,13 @@
 #include "ProcessTaskImageAnalyzer.h"
 
-#include <regex>
+#include <algorithm>
 #include <utility>
 
 #include "General/MatchImageAnalyzer.h"
 #include "General/OcrImageAnalyzer.h"
 #include "RuntimeStatus.h"
 #include "TaskData.h"
+#include "Utils/ImageSignature.hpp"
 #include "Utils/Logger.hpp"
 
 asst::ProcessTaskImageAnalyzer::ProcessTaskImageAnalyzer(const cv::Mat& image, std::vector<std::string> tasks_name)
@@ -45,32 +46,7 @@ bool asst::ProcessTaskImageAnalyzer::ocr_analyze(const std::shared_ptr<TaskInfo>
 {
     std::shared_ptr<OcrTaskInfo> ocr_task_ptr = std::dynamic_pointer_cast<OcrTaskInfo>(task_ptr);
 
-    // 先尝试从缓存的结果里找
-    // for (const TextRect& tr : m_ocr_cache) {
-    //    TextRect temp = tr;
-    //    for (const auto& [regex, new_str] : ocr_task_ptr->replace_map) {
-    //        temp.text = std::regex_replace(temp.text, std::regex(regex), new_str);
-    //    }
-    //    for (const auto& text : ocr_task_ptr->text) {
-    //        bool flag = false;
-    //        if (ocr_task_ptr->full_match) {
-    //            if (temp.text == text) {
-    //                flag = true;
-    //            }
-    //        }
-    //        else if (temp.text.find(text) != std::string::npos) {
-    //            flag = true;
-    //        }
-    //        // 即使找到了，也得在ROI里才行，不然过滤掉
-    //        if (flag && ocr_task_ptr->roi.include(tr.rect)) {
-    //            m_result = ocr_task_ptr;
-    //            m_result_rect = tr.rect;
-    //            ocr_task_ptr->region_of_appeared = m_result_rect;
-    //            Log.trace("ProcessTaskImageAnalyzer::ocr_analyze | found in cache", tr.to_string());
-    //            return true;
-    //        }
-    //    }
-    //}
+    // 识别区域内画面没变时，OcrPack 会直接返回缓存的识别结果，见 config.json 的 ocrCacheSize
     if (!m_ocr_analyzer) {
         m_ocr_analyzer = std::make_unique<OcrImageAnalyzer>(m_image);
     }
@@ -90,7 +66,6 @@ bool asst::ProcessTaskImageAnalyzer::ocr_analyze(const std::shared_ptr<TaskInfo>
         m_result = ocr_task_ptr;
         m_result_rect = res.rect;
         m_status->set_rect(ocr_task_ptr->name, m_result_rect);
-        // m_ocr_cache.insert(m_ocr_cache.end(), ocr_result.begin(), ocr_result.end());
         Log.trace("ProcessTaskImageAnalyzer::ocr_analyze | found", res.to_string());
     }
     return ret;
@@ -98,7 +73,6 @@ bool asst::ProcessTaskImageAnalyzer::ocr_analyze(const std::shared_ptr<TaskInfo>
 
 void asst::ProcessTaskImageAnalyzer::reset() noexcept
 {
-    // m_ocr_cache.clear();
     m_ocr_analyzer = nullptr;
     m_match_analyzer = nullptr;
 }
@@ -137,6 +111,62 @@ bool asst::ProcessTaskImageAnalyzer::analyze()
     return false;
 }
 
+uint64_t asst::ProcessTaskImageAnalyzer::calc_signature() const
+{
+    uint64_t signature = utils::SignatureSeed;
+    // 很多任务的识别区域是相同的（例如全屏），同一个区域只计算一次
+    std::vector<std::pair<Rect, uint64_t>> roi_cache;
+    auto add_roi = [&](const Rect& roi) {
+        Rect corrected = correct_rect(roi, m_image);
+        auto iter = std::ranges::find(roi_cache, corrected, &std::pair<Rect, uint64_t>::first);
+        if (iter == roi_cache.end()) {
+            uint64_t roi_hash = utils::roi_signature(m_image, make_rect<cv::Rect>(corrected));
+            iter = roi_cache.emplace(roi_cache.end(), corrected, roi_hash);
+        }
+        signature = utils::hash_combine(signature, &iter->second, sizeof(iter->second));
+    };
+    auto add_value = [&](const auto& value) { signature = utils::hash_combine(signature, &value, sizeof(value)); };
+    // 运行时可以通过 Task 修改任务的参数，影响识别结果的参数也要算进签名里
+    auto add_task_info = [&](const TaskInfo& task_info) {
+        add_value(task_info.algorithm);
+        add_value(task_info.cache);
+        if (const auto* match_info = dynamic_cast<const MatchTaskInfo*>(&task_info)) {
+            signature = utils::hash_combine(signature, match_info->templ_name);
+            add_value(match_info->templ_threshold);
+            add_value(match_info->special_threshold);
+            add_value(match_info->mask_range);
+            add_value(match_info->pyramid);
+        }
+        else if (const auto* ocr_info = dynamic_cast<const OcrTaskInfo*>(&task_info)) {
+            for (const std::string& text : ocr_info->text) {
+                add_value(text.size());
+                signature = utils::hash_combine(signature, text);
+            }
+            add_value(ocr_info->full_match);
+            // 替换规则在解析任务时编译，规则变了就是另一个对象
+            const void* replacer = ocr_info->replace_map.get();
+            add_value(replacer);
+        }
+    };
+
+    for (const std::string& task_name : m_tasks_name) {
+        signature = utils::hash_combine(signature, task_name);
+        auto task_ptr = Task.get(task_name);
+        if (task_ptr == nullptr) {
+            continue;
+        }
+        add_task_info(*task_ptr);
+        add_roi(task_ptr->roi);
+        // 上次识别到的位置可能会代替 roi 作为识别区域
+        if (m_status) {
+            if (auto region_opt = m_status->get_rect(task_name)) {
+                add_roi(region_opt.value());
+            }
+        }
+    }
+    return signature;
+}
+
 void asst::ProcessTaskImageAnalyzer::set_image(const cv::Mat image)
 {
     AbstractImageAnalyzer::set_image(image);
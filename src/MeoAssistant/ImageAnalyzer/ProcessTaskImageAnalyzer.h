@@ -1,6 +1,7 @@
 #pragma once
 #include "General/AbstractImageAnalyzer.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -23,6 +24,10 @@ namespace asst
 
         virtual bool analyze() override;
         void set_image(const cv::Mat image);
+        // 待识别的任务及其识别参数（阈值、文字、模板名等），以及各任务识别区域内画面缩小后的哈希
+        // 只是近似：画面的细微变化可能得到相同的签名，模板图片本身被替换（重新加载资源）也不会改变签名，
+        // 所以签名相同时识别结果多半相同，但不保证，调用者需要定期完整识别一次
+        uint64_t calc_signature() const;
 
         void set_tasks(std::vector<std::string> tasks_name);
         void set_status(std::shared_ptr<RuntimeStatus> status) noexcept;
@@ -46,6 +51,5 @@ namespace asst
         std::shared_ptr<TaskInfo> m_result = nullptr;
         std::shared_ptr<RuntimeStatus> m_status = nullptr;
         Rect m_result_rect;
-        // std::vector<TextRect> m_ocr_cache;
     };
 }
@@ -2,6 +2,7 @@
 
 #include "Utils/NoWarningCV.h"
 
+#include "General/FrameContext.h"
 #include "General/MultiMatchImageAnalyzer.h"
 #include "TaskData.h"
 #include "Utils/Logger.hpp"
@@ -46,9 +47,7 @@ const std::vector<asst::RoguelikeFormationImageAnalyzer::FormationOper>& asst::R
 
 bool asst::RoguelikeFormationImageAnalyzer::selected_analyze(const Rect& roi)
 {
-    cv::Mat img_roi = m_image(make_rect<cv::Rect>(roi));
-    cv::Mat hsv;
-    cv::cvtColor(img_roi, hsv, cv::COLOR_BGR2HSV);
+    cv::Mat hsv = frame().hsv(roi);
 
     const auto selected_task_ptr = Task.get<MatchTaskInfo>("RoguelikeFormationOperSelected");
     int h_low = selected_task_ptr->mask_range.first;
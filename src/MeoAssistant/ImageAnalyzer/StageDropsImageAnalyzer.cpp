@@ -4,9 +4,12 @@
 
 #include "Utils/NoWarningCV.h"
 
+#include "General/BatchMatchImageAnalyzer.h"
 #include "General/MatchImageAnalyzer.h"
 #include "General/OcrWithPreprocessImageAnalyzer.h"
+#include "Resource/GeneralConfiger.h"
 #include "Resource/ItemConfiger.h"
+#include "Resource/ItemIconIndex.h"
 #include "Resource/StageDropsConfiger.h"
 #include "TaskData.h"
 #include "Utils/AsstImageIo.hpp"
@@ -172,7 +175,9 @@ bool asst::StageDropsImageAnalyzer::analyze_drops()
 
     auto task_ptr = Task.get("StageDrops-Item");
 
-    bool has_error = false;
+    // 先把所有掉落物认出来，数量最后一起识别
+    std::vector<StageDropInfo> drops;
+    std::vector<Rect> item_rois;
     const auto& roi = task_ptr->roi;
     for (auto it = m_baseline.cbegin(); it != m_baseline.cend(); ++it) {
         const auto& [baseline, drop_type] = *it;
@@ -191,41 +196,51 @@ bool asst::StageDropsImageAnalyzer::analyze_drops()
                 item_roi = Rect(x, baseline.y + roi.y, roi.width, roi.height);
             }
 
-            std::string item = match_item(item_roi, drop_type, size - i, size);
-            int quantity = match_quantity(item_roi);
-            Log.info("Item id:", item, ", quantity:", quantity);
-#ifdef ASST_DEBUG
-            cv::rectangle(m_image_draw, make_rect<cv::Rect>(item_roi), cv::Scalar(0, 0, 255), 2);
-            cv::putText(m_image_draw, item, cv::Point(item_roi.x, item_roi.y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.5,
-                        cv::Scalar(0, 0, 255), 2);
-            cv::putText(m_image_draw, std::to_string(quantity), cv::Point(item_roi.x, item_roi.y + 10),
-                        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
-#endif
-            if (quantity <= 0) {
-                has_error = true;
-                Log.error(__FUNCTION__, "quantity error", quantity);
-            }
-            if (item.empty()) {
-                Log.warn(__FUNCTION__, "item id is empty");
-            }
             StageDropInfo info;
             info.drop_type = drop_type;
-            info.item_id = std::move(item);
-            info.quantity = quantity;
-
-            const std::string& name = ItemData.get_item_name(info.item_id);
-            info.item_name = name.empty() ? info.item_id : name;
+            info.item_id = match_item(item_roi, drop_type, size - i, size);
+            drops.emplace_back(std::move(info));
+            item_rois.emplace_back(item_roi);
+        }
+    }
 
-            static const std::unordered_map<StageDropType, std::string> DropTypeName = {
-                { StageDropType::Normal, "NORMAL_DROP" },     { StageDropType::Extra, "EXTRA_DROP" },
-                { StageDropType::Furniture, "FURNITURE" },    { StageDropType::Special, "SPECIAL_DROP" },
-                { StageDropType::ExpAndLMB, "EXP_LMB_DROP" }, { StageDropType::Sanity, "SANITY_DROP" },
-                { StageDropType::Reward, "REWARD_DROP" },     { StageDropType::Unknown, "UNKNOWN_DROP" }
-            };
-            info.drop_type_name = DropTypeName.at(drop_type);
+    std::vector<int> quantities = match_quantities(item_rois);
 
-            m_drops.emplace_back(std::move(info));
+    bool has_error = false;
+    for (size_t i = 0; i != drops.size(); ++i) {
+        StageDropInfo& info = drops[i];
+        const std::string& item = info.item_id;
+        int quantity = quantities[i];
+        Log.info("Item id:", item, ", quantity:", quantity);
+#ifdef ASST_DEBUG
+        const Rect& item_roi = item_rois[i];
+        cv::rectangle(m_image_draw, make_rect<cv::Rect>(item_roi), cv::Scalar(0, 0, 255), 2);
+        cv::putText(m_image_draw, item, cv::Point(item_roi.x, item_roi.y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+                    cv::Scalar(0, 0, 255), 2);
+        cv::putText(m_image_draw, std::to_string(quantity), cv::Point(item_roi.x, item_roi.y + 10),
+                    cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
+#endif
+        if (quantity <= 0) {
+            has_error = true;
+            Log.error(__FUNCTION__, "quantity error", quantity);
+        }
+        if (item.empty()) {
+            Log.warn(__FUNCTION__, "item id is empty");
         }
+        info.quantity = quantity;
+
+        const std::string& name = ItemData.get_item_name(info.item_id);
+        info.item_name = name.empty() ? info.item_id : name;
+
+        static const std::unordered_map<StageDropType, std::string> DropTypeName = {
+            { StageDropType::Normal, "NORMAL_DROP" },     { StageDropType::Extra, "EXTRA_DROP" },
+            { StageDropType::Furniture, "FURNITURE" },    { StageDropType::Special, "SPECIAL_DROP" },
+            { StageDropType::ExpAndLMB, "EXP_LMB_DROP" }, { StageDropType::Sanity, "SANITY_DROP" },
+            { StageDropType::Reward, "REWARD_DROP" },     { StageDropType::Unknown, "UNKNOWN_DROP" }
+        };
+        info.drop_type_name = DropTypeName.at(info.drop_type);
+
+        m_drops.emplace_back(std::move(info));
     }
     return !has_error;
 }
@@ -417,25 +432,31 @@ std::string asst::StageDropsImageAnalyzer::match_item(const Rect& roi, StageDrop
         return "4003"; // 合成玉
     }
 
-    auto match_item_with_templs = [&](const std::vector<std::string>& templs_list) -> std::string {
-        MatchImageAnalyzer analyzer(m_image);
+    auto match_templs = [&](std::vector<std::string> templs_list) -> std::string {
+        BatchMatchImageAnalyzer analyzer(m_image);
         analyzer.set_task_info("StageDrops-Item");
         analyzer.set_mask_with_close(true);
         analyzer.set_roi(roi);
-
-        double max_score = 0.0;
-        std::string matched;
-        for (const std::string& templ : templs_list) {
-            analyzer.set_templ_name(templ);
-            if (!analyzer.analyze()) {
-                continue;
+        analyzer.set_templ_names(std::move(templs_list));
+        analyzer.set_top_k(1);
+        if (!analyzer.analyze()) {
+            return {};
+        }
+        return analyzer.get_result().front().templ_name;
+    };
+    // 模板多的时候先用图标索引挑出几个候选，候选都没匹配上再全部匹配一遍
+    auto match_item_with_templs = [&](std::vector<std::string> templs_list) -> std::string {
+        constexpr size_t ShortlistSize = 8;
+        if (templs_list.size() > ShortlistSize) {
+            std::vector<std::string> candidates;
+            for (size_t index : ItemIconIndex::get_instance().shortlist(m_image, roi, templs_list, ShortlistSize)) {
+                candidates.emplace_back(templs_list.at(index));
             }
-            if (auto score = analyzer.get_result().score; score > max_score) {
-                max_score = score;
-                matched = templ;
+            if (std::string result = match_templs(std::move(candidates)); !result.empty()) {
+                return result;
             }
         }
-        return matched;
+        return match_templs(std::move(templs_list));
     };
 
     std::string result;
@@ -459,7 +480,7 @@ std::string asst::StageDropsImageAnalyzer::match_item(const Rect& roi, StageDrop
     return result;
 }
 
-int asst::StageDropsImageAnalyzer::match_quantity(const Rect& roi)
+asst::Rect asst::StageDropsImageAnalyzer::match_quantity_roi(const Rect& roi)
 {
     auto task_ptr = Task.get<MatchTaskInfo>("StageDrops-Quantity");
 
@@ -505,7 +526,7 @@ int asst::StageDropsImageAnalyzer::match_quantity(const Rect& roi)
     }
 
     if (contours.empty()) {
-        return 0;
+        return {};
     }
 
     // 前面的 split 算法经过了大量的测试集验证，分割效果一切正常
@@ -514,19 +535,52 @@ int asst::StageDropsImageAnalyzer::match_quantity(const Rect& roi)
     int far_left = contours.back().start;
     int far_right = contours.front().end;
 
+    return Rect(quantity_roi.x + far_left, quantity_roi.y, far_right - far_left, quantity_roi.height);
+}
+
+std::vector<int> asst::StageDropsImageAnalyzer::match_quantities(const std::vector<Rect>& item_rois)
+{
+    LogTraceFunction;
+
+    auto task_ptr = Task.get<MatchTaskInfo>("StageDrops-Quantity");
+
+    std::vector<int> quantities(item_rois.size(), 0);
+    std::vector<size_t> indices;
+    std::vector<Rect> ocr_rois;
+    for (size_t i = 0; i != item_rois.size(); ++i) {
+        Rect ocr_roi = match_quantity_roi(item_rois[i]);
+        if (ocr_roi.empty()) {
+            continue;
+        }
+        indices.emplace_back(i);
+        ocr_rois.emplace_back(ocr_roi);
+    }
+    if (ocr_rois.empty()) {
+        return quantities;
+    }
+
+    // 所有数量一起交给 analyzer，开了 ocrBatch 时一次识别完
     OcrWithPreprocessImageAnalyzer analyzer(m_image);
     analyzer.set_task_info("NumberOcrReplace");
-    analyzer.set_roi(Rect(quantity_roi.x + far_left, quantity_roi.y, far_right - far_left, quantity_roi.height));
+    analyzer.set_batch_rois(std::move(ocr_rois));
+    analyzer.set_use_batch_ocr(m_use_batch_ocr.value_or(Configer.get_options().ocr_batch));
     analyzer.set_expansion(1);
     analyzer.set_threshold(task_ptr->mask_range.first, task_ptr->mask_range.second);
     analyzer.set_use_char_model(true);
+    analyzer.analyze();
 
-    if (!analyzer.analyze()) {
-        return 0;
+    const auto& batch_result = analyzer.get_batch_result();
+    for (size_t i = 0; i != batch_result.size(); ++i) {
+        if (batch_result[i].empty()) {
+            continue;
+        }
+        quantities[indices[i]] = parse_quantity(batch_result[i].front());
     }
+    return quantities;
+}
 
-    const auto& result = analyzer.get_result().front();
-
+int asst::StageDropsImageAnalyzer::parse_quantity(const TextRect& result)
+{
 #ifdef ASST_DEBUG
     cv::rectangle(m_image_draw, make_rect<cv::Rect>(result.rect), cv::Scalar(0, 0, 255));
     cv::putText(m_image_draw, result.text, cv::Point(result.rect.x, result.rect.y - 5), cv::FONT_HERSHEY_SIMPLEX, 0.5,
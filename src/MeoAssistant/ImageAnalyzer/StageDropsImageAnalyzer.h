@@ -2,6 +2,8 @@
 #include "General/AbstractImageAnalyzer.h"
 #include "Resource/StageDropsConfiger.h"
 
+#include <optional>
+
 namespace asst
 {
     class StageDropsImageAnalyzer final : public AbstractImageAnalyzer
@@ -17,6 +19,8 @@ namespace asst
 
         // <drop_type, <item_id, quantity>>
         const auto& get_drops() const noexcept { return m_drops; }
+        // 数量是否拼成一张图一次识别，不设置时见 config.json 的 ocrBatch
+        void set_use_batch_ocr(bool use_batch_ocr) noexcept { m_use_batch_ocr = use_batch_ocr; }
 
     protected:
         bool analyze_stage_code();
@@ -25,7 +29,11 @@ namespace asst
         bool analyze_baseline();
         bool analyze_drops();
 
-        int match_quantity(const Rect& roi);
+        // 数量文字所在的区域，没有数字时返回空的
+        Rect match_quantity_roi(const Rect& roi);
+        // 一次识别所有掉落物的数量，与 item_rois 一一对应，识别失败的为 0
+        std::vector<int> match_quantities(const std::vector<Rect>& item_rois);
+        int parse_quantity(const TextRect& result);
         StageDropType match_droptype(const Rect& roi);
         std::string match_item(const Rect& roi, StageDropType type, int index, int size);
 
@@ -35,5 +43,6 @@ namespace asst
         std::vector<std::pair<Rect, StageDropType>> m_baseline;
         // <drop_type, <item_id, quantity>>
         std::vector<StageDropInfo> m_drops;
+        std::optional<bool> m_use_batch_ocr;
     };
 }
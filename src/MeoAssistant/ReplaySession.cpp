@@ -0,0 +1,251 @@
+#include "ReplaySession.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+#include <meojson/json.hpp>
+
+#include "SessionRecorder.h"
+#include "Utils/AsstImageIo.hpp"
+#include "Utils/Logger.hpp"
+#include "Utils/Platform.hpp"
+
+std::unique_ptr<asst::ReplaySession> asst::ReplaySession::open(const std::filesystem::path& path)
+{
+    LogTraceFunction;
+    Log.info("open replay", path);
+
+    auto session = std::make_unique<ReplaySession>();
+    bool loaded = false;
+    if (std::filesystem::is_regular_file(path)) {
+        session->m_dir = path.parent_path();
+        loaded = session->load_archive(path);
+    }
+    else if (std::filesystem::is_directory(path)) {
+        session->m_dir = path;
+        auto manifest_path = path / "replay.json";
+        loaded = std::filesystem::exists(manifest_path) ? session->load_manifest(manifest_path)
+                                                        : session->load_images(path);
+    }
+    else {
+        Log.error("replay path does not exist", path);
+        return nullptr;
+    }
+    if (!loaded || session->m_frames.empty()) {
+        Log.error("no frame to replay", path);
+        return nullptr;
+    }
+
+    cv::Mat first = session->next_frame();
+    if (first.empty()) {
+        Log.error("read first frame failed", session->m_frames.front().file);
+        return nullptr;
+    }
+    session->m_frame_size = first.size();
+    // next_frame 会推进到下一张，打开时读的这一张不算
+    session->m_cur_index = 0;
+
+    Log.info("replay frames:", session->m_frames.size(), ", recorded actions:", session->m_recorded_actions.size(),
+             ", size:", first.cols, first.rows);
+    return session;
+}
+
+bool asst::ReplaySession::load_manifest(const std::filesystem::path& manifest_path)
+{
+    auto ret = json::open(manifest_path, true);
+    if (!ret) {
+        Log.error("Json open failed", manifest_path);
+        return false;
+    }
+    const auto& root = ret.value();
+
+    try {
+        for (const json::value& frame_json : root.at("frames").as_array()) {
+            Frame frame;
+            frame.file = m_dir / utils::path(frame_json.at("file").as_string());
+            frame.action = static_cast<size_t>(frame_json.get("action", 0));
+            m_frames.emplace_back(std::move(frame));
+        }
+        if (auto opt = root.find<json::array>("actions")) {
+            for (const json::value& action : opt.value()) {
+                m_recorded_actions.emplace_back(action.as_string());
+            }
+        }
+    }
+    catch (const json::exception& e) {
+        Log.error("Json parse failed", manifest_path, e.what());
+        return false;
+    }
+
+    // 同一次操作之后的多张图保持录制时的顺序
+    std::stable_sort(m_frames.begin(), m_frames.end(),
+                     [](const Frame& lhs, const Frame& rhs) { return lhs.action < rhs.action; });
+    return true;
+}
+
+bool asst::ReplaySession::load_images(const std::filesystem::path& dir)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        auto ext = utils::path_to_utf8_string(entry.path().extension());
+        std::ranges::transform(ext, ext.begin(), [](char c) -> char { return static_cast<char>(std::tolower(c)); });
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp") {
+            files.emplace_back(entry.path());
+        }
+    }
+    std::ranges::sort(files);
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        m_frames.emplace_back(Frame { files[i], 0, 0, i });
+    }
+    return true;
+}
+
+bool asst::ReplaySession::load_archive(const std::filesystem::path& archive_path)
+{
+    using namespace session_archive;
+
+    std::ifstream file(archive_path, std::ios::in | std::ios::binary);
+    char magic[Magic.size()] = { 0 };
+    if (!file.read(magic, sizeof(magic)) || std::string_view(magic, sizeof(magic)) != Magic) {
+        Log.error("not a record file", archive_path);
+        return false;
+    }
+
+    std::error_code ec;
+    const uint64_t file_size = std::filesystem::file_size(archive_path, ec);
+
+    // 依次读取每条记录的头部，跳过内容，只有 FrameRef 和 Action 需要读内容
+    char header_buf[RecordHeader::Size] = { 0 };
+    uint64_t offset = Magic.size();
+    while (file.read(header_buf, sizeof(header_buf))) {
+        RecordHeader header = RecordHeader::deserialize(header_buf);
+        uint64_t payload_offset = offset + RecordHeader::Size;
+        if (header.type == RecordType::Index) {
+            break;
+        }
+        if (!ec && payload_offset + header.size > file_size) {
+            // 录制时崩溃或者磁盘满了，最后一条记录不完整，前面的仍然可以用
+            Log.warn("record file is truncated", archive_path);
+            break;
+        }
+        switch (header.type) {
+        case RecordType::Frame:
+            m_frames.emplace_back(Frame { archive_path, payload_offset, header.size, header.aux });
+            file.seekg(header.size, std::ios::cur);
+            break;
+        case RecordType::FrameRef: {
+            uint64_t ref_offset = 0;
+            file.read(reinterpret_cast<char*>(&ref_offset), sizeof(ref_offset));
+            // 引用的是那一帧记录的开头，需要再读一下它的大小
+            auto cur_pos = file.tellg();
+            file.seekg(static_cast<std::streamoff>(ref_offset));
+            char ref_header_buf[RecordHeader::Size] = { 0 };
+            file.read(ref_header_buf, sizeof(ref_header_buf));
+            RecordHeader ref_header = RecordHeader::deserialize(ref_header_buf);
+            file.seekg(cur_pos);
+            m_frames.emplace_back(Frame { archive_path, ref_offset + RecordHeader::Size, ref_header.size, header.aux });
+        } break;
+        case RecordType::Action: {
+            std::string action(header.size, '\0');
+            file.read(action.data(), static_cast<std::streamsize>(action.size()));
+            m_recorded_actions.emplace_back(std::move(action));
+        } break;
+        default:
+            Log.error("unknown record type", static_cast<int>(header.type), ", offset:", offset);
+            return !m_frames.empty();
+        }
+        if (!file) {
+            // 录制时崩溃导致最后一条记录不完整，前面的仍然可以用
+            Log.warn("record file is truncated", archive_path);
+            break;
+        }
+        offset = payload_offset + header.size;
+    }
+
+    std::stable_sort(m_frames.begin(), m_frames.end(),
+                     [](const Frame& lhs, const Frame& rhs) { return lhs.action < rhs.action; });
+    return true;
+}
+
+cv::Mat asst::ReplaySession::read_frame(const Frame& frame) const
+{
+    if (frame.size == 0) {
+        return asst::imread(frame.file);
+    }
+    std::ifstream file(frame.file, std::ios::in | std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(frame.offset));
+    std::vector<uchar> buffer(frame.size);
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()))) {
+        return {};
+    }
+    return cv::imdecode(buffer, cv::IMREAD_COLOR);
+}
+
+cv::Mat asst::ReplaySession::next_frame()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    size_t index = m_cur_index;
+    // 当前操作次数之后录制的图都已经用过了，就停在最后一张，和画面不再变化时一样
+    auto group_end = std::ranges::upper_bound(m_frames, m_action_count, std::less {}, &Frame::action);
+    if (static_cast<ptrdiff_t>(index) + 1 < group_end - m_frames.begin()) {
+        ++m_cur_index;
+    }
+
+    if (index != m_loaded_index) {
+        m_loaded_frame = read_frame(m_frames[index]);
+        m_loaded_index = index;
+        if (m_loaded_frame.empty()) {
+            Log.error("replay read frame failed", m_frames[index].file);
+        }
+    }
+    return m_loaded_frame;
+}
+
+void asst::ReplaySession::on_action(const std::string& action)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    Log.info("Replay action", m_action_count, "|", action);
+    if (!m_diverged && !m_recorded_actions.empty()) {
+        // 点击的位置是在区域内随机的，只比较操作类型
+        auto action_type = [](const std::string& str) { return str.substr(0, str.find(' ')); };
+        if (m_action_count >= m_recorded_actions.size()) {
+            Log.warn("Replay diverged: more actions than recorded", m_recorded_actions.size());
+            m_diverged = true;
+        }
+        else if (action_type(action) != action_type(m_recorded_actions[m_action_count])) {
+            Log.warn("Replay diverged at action", m_action_count, ", recorded:", m_recorded_actions[m_action_count]);
+            m_diverged = true;
+        }
+    }
+
+    ++m_action_count;
+    // 切到这次操作之后录制的第一张图；这次操作之后没有录制新的图，就接着当前的图继续
+    auto group_end = std::ranges::upper_bound(m_frames, m_action_count, std::less {}, &Frame::action);
+    if (group_end == m_frames.begin()) {
+        return;
+    }
+    size_t group_action = std::prev(group_end)->action;
+    auto group_begin = std::ranges::lower_bound(m_frames, group_action, std::less {}, &Frame::action);
+    m_cur_index = (std::max)(m_cur_index, static_cast<size_t>(group_begin - m_frames.begin()));
+}
+
+cv::Mat asst::ReplaySession::frame_at(size_t index) const
+{
+    if (index >= m_frames.size()) {
+        return {};
+    }
+    return read_frame(m_frames[index]);
+}
+
+size_t asst::ReplaySession::action_count() const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_action_count;
+}
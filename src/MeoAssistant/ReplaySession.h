@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 离线回放录制好的截图序列，不需要模拟器就能完整地跑任务，用于性能测试和回归测试
+    // 录制目录中的 replay.json 格式：
+    // {
+    //     "frames": [ { "file": "000001.png", "action": 0 }, ... ], // action 为截这张图之前已经执行了几次操作
+    //     "actions": [ "click 100 200", "swipe 1 2 3 4 500", ... ] // 可选，录制时执行的操作，用于检查回放是否偏离
+    // }
+    // 没有 replay.json 时，目录中的图片按文件名排序，每执行一次操作换下一张
+    // 也可以直接打开 SessionRecorder 录制的文件
+    class ReplaySession
+    {
+    public:
+        ReplaySession() = default;
+        ReplaySession(const ReplaySession&) = delete;
+        ReplaySession(ReplaySession&&) = delete;
+        ~ReplaySession() = default;
+
+        static std::unique_ptr<ReplaySession> open(const std::filesystem::path& path);
+
+        // 当前操作次数对应的下一张图：同一次操作之后录了多张图时依次返回，到最后一张后一直返回最后一张
+        cv::Mat next_frame();
+        // 执行一次操作，之后的截图切换到这次操作之后录制的图
+        void on_action(const std::string& action);
+        // 第 index 张图（按操作次数排序），不影响回放进度，用于离线逐张分析录制的图
+        cv::Mat frame_at(size_t index) const;
+
+        cv::Size frame_size() const noexcept { return m_frame_size; }
+        size_t frame_count() const noexcept { return m_frames.size(); }
+        size_t action_count() const;
+
+        ReplaySession& operator=(const ReplaySession&) = delete;
+        ReplaySession& operator=(ReplaySession&&) = delete;
+
+    private:
+        struct Frame
+        {
+            std::filesystem::path file;
+            uint64_t offset = 0; // 在录制文件中的偏移量，size 为 0 时表示 file 是单独的图片
+            uint32_t size = 0;
+            size_t action = 0;
+        };
+
+        bool load_manifest(const std::filesystem::path& manifest_path);
+        bool load_images(const std::filesystem::path& dir);
+        bool load_archive(const std::filesystem::path& archive_path);
+        cv::Mat read_frame(const Frame& frame) const;
+
+        std::filesystem::path m_dir;
+        std::vector<Frame> m_frames; // 按 action 排序
+        std::vector<std::string> m_recorded_actions;
+        cv::Size m_frame_size;
+
+        mutable std::mutex m_mutex;
+        size_t m_action_count = 0;        // 已经执行的操作次数
+        size_t m_cur_index = 0;           // 下一次返回的图在 m_frames 中的下标
+        size_t m_loaded_index = SIZE_MAX; // m_loaded_frame 对应的下标
+        cv::Mat m_loaded_frame;
+        bool m_diverged = false;
+    };
+}
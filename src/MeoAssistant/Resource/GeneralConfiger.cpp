@@ -15,6 +15,13 @@ bool asst::GeneralConfiger::parse(const json::value& json)
         // m_options.print_window = options_json.at("printWindow").as_boolean();
         m_options.adb_extra_swipe_dist = options_json.get("adbExtraSwipeDist", 100);
         m_options.adb_extra_swipe_duration = options_json.get("adbExtraSwipeDuration", -1);
+        m_options.adb_native = options_json.get("adbNative", true);
+        m_options.screencap_prefetch = options_json.get("screencapPrefetch", false);
+        m_options.screencap_reprobe_interval = options_json.get("screencapReprobeInterval", 0);
+        m_options.session_record = options_json.get("sessionRecord", false);
+        m_options.ocr_pool_size = options_json.get("ocrPoolSize", 1);
+        m_options.ocr_cache_size = options_json.get("ocrCacheSize", 128);
+        m_options.ocr_batch = options_json.get("ocrBatch", false);
         m_options.penguin_report.cmd_format = options_json.get("penguinReport", "cmdFormat", std::string());
         m_options.yituliu_report.cmd_format = options_json.get("yituliuReport", "cmdFormat", std::string());
         m_options.depot_export_template.ark_planner =
@@ -35,6 +42,9 @@ bool asst::GeneralConfiger::parse(const json::value& json)
         adb.uuid = cfg_json.at("uuid").as_string();
         adb.click = cfg_json.at("click").as_string();
         adb.swipe = cfg_json.at("swipe").as_string();
+        adb.shell = cfg_json.get("shell", std::string());
+        adb.shell_click = cfg_json.get("shellClick", std::string());
+        adb.shell_swipe = cfg_json.get("shellSwipe", std::string());
         adb.display = cfg_json.at("display").as_string();
         adb.display_format = cfg_json.at("displayFormat").as_string();
         adb.screencap_raw_with_gzip = cfg_json.at("screencapRawWithGzip").as_string();
@@ -42,6 +52,7 @@ bool asst::GeneralConfiger::parse(const json::value& json)
         adb.nc_address = cfg_json.at("ncAddress").as_string();
         adb.nc_port = static_cast<unsigned short>(cfg_json.at("ncPort").as_integer());
         adb.screencap_encode = cfg_json.at("screencapEncode").as_string();
+        adb.screencap_raw_stream = cfg_json.get("screencapRawStream", std::string());
         adb.release = cfg_json.at("release").as_string();
         adb.start = cfg_json.at("start").as_string();
         adb.stop = cfg_json.at("stop").as_string();
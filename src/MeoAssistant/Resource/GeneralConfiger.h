@@ -39,6 +39,13 @@ namespace asst
                                            // adb有bug，同样的参数，偶尔会划得非常远。
                                            // 额外做一个短程滑动，把之前的停下来。
                                            // 若小于0，则关闭额外滑动功能。
+        bool adb_native = true;            // 直接通过 socket 与 adb server 通信，不支持的命令仍然启动 adb 进程
+        bool screencap_prefetch = false;   // 分析当前截图的同时，在后台预先截下一张图
+        int screencap_reprobe_interval = 0; // 每隔多少秒重新比较一次截图方式，0 为不比较
+        bool session_record = false;        // 录制截图和操作，用于离线回放
+        int ocr_pool_size = 1;              // OCR 引擎数量，多个实例同时识别文字时各用一个，互不等待
+        int ocr_cache_size = 128;           // OCR 结果缓存的条数，画面没变的区域直接用上次的结果，0 为不缓存
+        bool ocr_batch = false;             // 材料数量拼成一张图一次识别，见 DebugTask 的 ocr_batch_compare
         PenguinReportCfg penguin_report;   // 企鹅物流汇报：
                                          // 每次到结算界面，汇报掉落数据至企鹅物流 https://penguin-stats.cn/
         DepotExportTemplate depot_export_template; // 仓库识别结果导出模板
@@ -58,12 +65,16 @@ namespace asst
         std::string uuid;
         std::string click;
         std::string swipe;
+        std::string shell;
+        std::string shell_click;
+        std::string shell_swipe;
         std::string display;
         std::string screencap_raw_with_gzip;
         std::string screencap_raw_by_nc;
         std::string nc_address;
         unsigned short nc_port = 0U;
         std::string screencap_encode;
+        std::string screencap_raw_stream; // 在设备上执行，每从 stdin 读到一行就输出一张 raw 截图
         std::string release;
         std::string start;
         std::string stop;
@@ -0,0 +1,116 @@
+#include "ItemIconIndex.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Utils/NoWarningCV.h"
+
+#include "Resource/TemplResource.h"
+#include "Utils/Logger.hpp"
+
+void asst::ItemIconIndex::build(const std::unordered_set<std::string>& item_ids)
+{
+    LogTraceFunction;
+
+    auto& templ_res = TemplResource::get_instance();
+    std::unordered_map<std::string, Descriptor> descriptors;
+    for (const std::string& id : item_ids) {
+        const cv::Mat templ = templ_res.get_templ(id);
+        if (templ.empty()) {
+            continue;
+        }
+        // 与识别材料时的掩码一致，去掉纯黑的背景
+        cv::Mat mask = TemplResource::make_mask(templ, { 1, 255 }, true);
+        Descriptor desc = calc_descriptor(templ, mask);
+        if (desc.total == 0) {
+            continue;
+        }
+        descriptors.emplace(id, desc);
+    }
+    Log.info(__FUNCTION__, "indexed", descriptors.size(), "/", item_ids.size(), "items");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_descriptors = std::move(descriptors);
+}
+
+std::vector<size_t> asst::ItemIconIndex::shortlist(const cv::Mat& image, const Rect& roi,
+                                                   std::span<const std::string> item_ids, size_t count) const
+{
+    std::vector<size_t> result(item_ids.size());
+    std::iota(result.begin(), result.end(), 0);
+    if (item_ids.size() <= count) {
+        return result;
+    }
+
+    const cv::Rect rect = make_rect<cv::Rect>(roi) & cv::Rect(0, 0, image.cols, image.rows);
+    if (rect.empty()) {
+        return result;
+    }
+    const Descriptor roi_desc = calc_descriptor(image(rect), cv::Mat());
+
+    std::vector<size_t> unindexed;
+    std::vector<std::pair<double, size_t>> scored;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < item_ids.size(); ++i) {
+            if (auto iter = m_descriptors.find(item_ids[i]); iter != m_descriptors.cend()) {
+                scored.emplace_back(containment(roi_desc, iter->second), i);
+            }
+            else {
+                unindexed.emplace_back(i);
+            }
+        }
+    }
+
+    // 得分相同时下标小的优先
+    const size_t kept = (std::min)(count, scored.size());
+    std::partial_sort(scored.begin(), scored.begin() + kept, scored.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+    });
+
+    result = std::move(unindexed);
+    for (size_t i = 0; i < kept; ++i) {
+        result.emplace_back(scored[i].second);
+    }
+    std::ranges::sort(result);
+
+    if (kept != 0) {
+        Log.trace(__FUNCTION__, "|", item_ids.size(), "->", result.size(), "candidates, best:",
+                  item_ids[scored.front().second], "score:", scored.front().first);
+    }
+    return result;
+}
+
+asst::ItemIconIndex::Descriptor asst::ItemIconIndex::calc_descriptor(const cv::Mat& bgr, const cv::Mat& mask)
+{
+    cv::Mat hsv;
+    cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+
+    Descriptor desc;
+    for (int r = 0; r < hsv.rows; ++r) {
+        const auto* pixel = hsv.ptr<cv::Vec3b>(r);
+        const uchar* mask_row = mask.empty() ? nullptr : mask.ptr<uchar>(r);
+        for (int c = 0; c < hsv.cols; ++c) {
+            if (mask_row && mask_row[c] == 0) {
+                continue;
+            }
+            const auto& [h, s, v] = pixel[c].val;
+            const int s_bin = s * SatBins / 256;
+            const int v_bin = v * ValBins / 256;
+            // 饱和度低的像素色相不稳定，都归到同一档
+            const int h_bin = s_bin == 0 ? 0 : (std::min)(h * HueBins / 180, HueBins - 1);
+            desc.hist[(h_bin * SatBins + s_bin) * ValBins + v_bin] += 1.0F;
+            desc.total += 1.0F;
+        }
+    }
+    return desc;
+}
+
+double asst::ItemIconIndex::containment(const Descriptor& roi_desc, const Descriptor& templ_desc)
+{
+    double common = 0.0;
+    for (size_t i = 0; i < BinCount; ++i) {
+        common += (std::min)(roi_desc.hist[i], templ_desc.hist[i]);
+    }
+    return common / templ_desc.total;
+}
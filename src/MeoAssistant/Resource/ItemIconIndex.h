@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Utils/SingletonHolder.hpp"
+
+#include <array>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Utils/AsstTypes.h"
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 材料图标的颜色索引。加载资源时为每个材料图标算一个 HSV 颜色直方图，
+    // 识别时先用直方图从所有材料里挑出少数几个候选，再只对候选做模板匹配
+    class ItemIconIndex final : public SingletonHolder<ItemIconIndex>
+    {
+    public:
+        virtual ~ItemIconIndex() override = default;
+
+        // 模板取自 TemplResource，需要在材料模板加载完之后调用
+        void build(const std::unordered_set<std::string>& item_ids);
+
+        // 返回 item_ids 中与 roi 内颜色最吻合的至多 count 个的下标，按下标从小到大排列
+        // 不在索引中的材料（没有模板等）无法排除，总是包含在结果里
+        std::vector<size_t> shortlist(const cv::Mat& image, const Rect& roi, std::span<const std::string> item_ids,
+                                      size_t count) const;
+
+    private:
+        // H 12 档 x S 3 档 x V 3 档，分得粗一些，容忍截图与模板之间的轻微色差
+        static constexpr int HueBins = 12;
+        static constexpr int SatBins = 3;
+        static constexpr int ValBins = 3;
+        static constexpr size_t BinCount = HueBins * SatBins * ValBins;
+        using Histogram = std::array<float, BinCount>;
+
+        struct Descriptor
+        {
+            Histogram hist {};
+            float total = 0.0F; // 掩码内的像素数
+        };
+
+        // mask 为空时统计所有像素
+        static Descriptor calc_descriptor(const cv::Mat& bgr, const cv::Mat& mask);
+        // 模板的像素有多大比例能在 roi 里找到同一档的颜色，图标完整地出现在 roi 中时接近 1
+        static double containment(const Descriptor& roi_desc, const Descriptor& templ_desc);
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Descriptor> m_descriptors;
+    };
+}
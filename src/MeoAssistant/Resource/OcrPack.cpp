@@ -5,7 +5,9 @@
 #include "Utils/NoWarningCV.h"
 #include <PaddleOCR/paddle_ocr.h>
 
+#include "Resource/GeneralConfiger.h"
 #include "Utils/Demangle.hpp"
+#include "Utils/ImageSignature.hpp"
 #include "Utils/Logger.hpp"
 #include "Utils/Platform.hpp"
 #include "Utils/StringMisc.hpp"
@@ -26,20 +28,34 @@ static std::filesystem::path prepare_paddle_dir(const std::filesystem::path& dir
 asst::OcrPack::OcrPack()
 {
     Log.info("hardware_concurrency:", std::thread::hardware_concurrency());
+}
+
+asst::OcrPack::~OcrPack()
+{
+    std::unique_lock<std::mutex> lock(m_pool_mutex);
+    m_pool_cv.wait(lock, [&]() { return m_idle_engines.size() == m_engines.size(); });
+    m_idle_engines.clear();
+    m_engines.clear();
+}
+
+asst::OcrPack::Engine::Engine()
+{
     for (size_t i = 0; i != MaxBoxSize; ++i) {
         static constexpr size_t MaxTextSize = 4096;
-        *(m_strs_buffer + i) = new char[MaxTextSize];
-        // memset(*(m_strs_buffer + i), 0, MaxTextSize);
+        *(strs_buffer + i) = new char[MaxTextSize];
+        // memset(*(strs_buffer + i), 0, MaxTextSize);
     }
 }
 
-asst::OcrPack::~OcrPack()
+asst::OcrPack::Engine::~Engine()
 {
     for (size_t i = 0; i != MaxBoxSize; ++i) {
-        delete[] *(m_strs_buffer + i);
+        delete[] *(strs_buffer + i);
     }
 
-    PaddleOcrDestroy(m_ocr);
+    if (ocr != nullptr) {
+        PaddleOcrDestroy(ocr);
+    }
 }
 
 bool asst::OcrPack::load(const std::filesystem::path& path)
@@ -61,10 +77,6 @@ bool asst::OcrPack::load(const std::filesystem::path& path)
     const auto rec_filename = paddle_dir / asst::utils::path(RecName);
     const auto keys_filename = paddle_dir / asst::utils::path(KeysName);
 
-    if (m_ocr != nullptr) {
-        PaddleOcrDestroy(m_ocr);
-    }
-
     const auto det4paddle = asst::utils::path_to_ansi_string(dst_filename);
     const auto rec4paddle = asst::utils::path_to_ansi_string(rec_filename);
     const auto keys4paddle = asst::utils::path_to_ansi_string(keys_filename);
@@ -73,7 +85,19 @@ bool asst::OcrPack::load(const std::filesystem::path& path)
         return false;
     }
 
-    m_ocr = PaddleOcrCreate(det4paddle.c_str(), rec4paddle.c_str(), keys4paddle.c_str(), nullptr);
+    // 临时目录加载完就删了，所以引擎都在这里一次创建好
+    const size_t pool_size = static_cast<size_t>((std::max)(Configer.get_options().ocr_pool_size, 1));
+    std::vector<std::unique_ptr<Engine>> engines;
+    for (size_t i = 0; i != pool_size; ++i) {
+        auto engine = std::make_unique<Engine>();
+        engine->ocr = PaddleOcrCreate(det4paddle.c_str(), rec4paddle.c_str(), keys4paddle.c_str(), nullptr);
+        if (engine->ocr == nullptr) {
+            Log.error("PaddleOcrCreate failed, index:", i);
+            break;
+        }
+        engines.emplace_back(std::move(engine));
+    }
+    Log.info("OcrPack::load | engines:", engines.size(), "/", pool_size);
 
     if (use_temp_dir) {
         // files can be removed after load
@@ -85,67 +109,196 @@ bool asst::OcrPack::load(const std::filesystem::path& path)
         }).detach();
     }
 
-    return m_ocr != nullptr;
+    if (engines.empty()) {
+        return false;
+    }
+
+    {
+        // 模型可能换了，之前的识别结果不能再用
+        std::unique_lock<std::mutex> cache_lock(m_cache_mutex);
+        m_cache_capacity = static_cast<size_t>((std::max)(Configer.get_options().ocr_cache_size, 0));
+        m_cache.clear();
+        m_cache_index.clear();
+    }
+
+    // 重新加载时等正在用的引擎都还回来再替换
+    std::unique_lock<std::mutex> lock(m_pool_mutex);
+    m_pool_cv.wait(lock, [&]() { return m_idle_engines.size() == m_engines.size(); });
+    m_engines = std::move(engines);
+    m_idle_engines.clear();
+    for (const auto& engine : m_engines) {
+        m_idle_engines.emplace_back(engine.get());
+    }
+    lock.unlock();
+    m_pool_cv.notify_all();
+
+    return true;
+}
+
+std::shared_ptr<asst::OcrPack::Engine> asst::OcrPack::acquire_engine()
+{
+    std::unique_lock<std::mutex> lock(m_pool_mutex);
+    if (m_engines.empty()) {
+        return nullptr;
+    }
+    m_pool_cv.wait(lock, [&]() { return !m_idle_engines.empty(); });
+    Engine* engine = m_idle_engines.back();
+    m_idle_engines.pop_back();
+
+    return std::shared_ptr<Engine>(engine, [this](Engine* released) {
+        {
+            std::unique_lock<std::mutex> release_lock(m_pool_mutex);
+            m_idle_engines.emplace_back(released);
+        }
+        m_pool_cv.notify_all();
+    });
 }
 
 std::vector<asst::TextRect> asst::OcrPack::recognize(const cv::Mat& image, const asst::TextRectProc& pred,
                                                      bool without_det, bool trim)
+{
+    // 缓存的是 trim 和 pred 之前的原始结果，pred 可能会修改结果，每次都要重新过一遍
+    std::vector<TextRect> raw_result;
+    std::optional<uint64_t> cache_key;
+    if (get_cache_capacity() != 0 && !image.empty()) {
+        const bool with_det = !without_det;
+        cache_key = utils::hash_image(image, utils::hash_combine(utils::SignatureSeed, &with_det, sizeof(with_det)));
+    }
+    if (auto cached = cache_key ? find_cache(*cache_key) : std::nullopt) {
+        raw_result = std::move(*cached);
+    }
+    else {
+        raw_result = run_engine(image, without_det);
+        if (cache_key) {
+            insert_cache(*cache_key, raw_result);
+        }
+    }
+
+    std::vector<TextRect> result;
+    for (TextRect tr : raw_result) {
+        if (trim) {
+            utils::string_trim(tr.text);
+        }
+        if (!pred || pred(tr)) {
+            result.emplace_back(std::move(tr));
+        }
+    }
+
+    Log.trace("OcrPack::recognize | raw:", raw_result);
+    Log.trace("OcrPack::recognize | proc:", result);
+    return result;
+}
+
+std::vector<asst::TextRect> asst::OcrPack::run_engine(const cv::Mat& image, bool without_det)
 {
     size_t size = 0;
 
+    auto engine = acquire_engine();
+    if (!engine) {
+        Log.error("OcrPack::recognize | not loaded");
+        return {};
+    }
+
     std::string class_type = utils::demangle(typeid(*this).name());
+    // Paddle 的接口只接受连续的数据，不支持行跨度。
     // 如果是带 ROI 的 cv::Mat, data 仍是指向完整的图片数据，仅通过内部的一些其他参数标识 ROI
-    // 直接取 data 拿到的不是正确的图，所以拷贝一份出来
-    cv::Mat copied = image.clone();
+    // 直接取 data 拿到的不是正确的图，这种情况拷贝到复用的缓冲区里；本身连续的（整张图、整行的 ROI）直接传
+    // Paddle 只读取传入的数据，不会修改
+    const cv::Mat* input = &image;
+    if (!image.isContinuous()) {
+        image.copyTo(engine->scratch);
+        input = &engine->scratch;
+    }
     if (!without_det) {
         Log.trace("Ocr System with", class_type);
-        PaddleOcrSystemWithData(m_ocr, copied.rows, copied.cols, copied.type(), copied.data, false, m_boxes_buffer,
-                                m_strs_buffer, m_scores_buffer, &size, nullptr, nullptr);
+        PaddleOcrSystemWithData(engine->ocr, input->rows, input->cols, input->type(), input->data, false,
+                                engine->boxes_buffer, engine->strs_buffer, engine->scores_buffer, &size, nullptr,
+                                nullptr);
     }
     else {
         Log.trace("Ocr Rec with", class_type);
-        PaddleOcrRecWithData(m_ocr, copied.rows, copied.cols, copied.type(), copied.data, m_strs_buffer,
-                             m_scores_buffer, &size, nullptr, nullptr);
+        PaddleOcrRecWithData(engine->ocr, input->rows, input->cols, input->type(), input->data, engine->strs_buffer,
+                             engine->scores_buffer, &size, nullptr, nullptr);
     }
 
-    std::vector<TextRect> result;
     std::vector<TextRect> raw_result;
-
     for (size_t i = 0; i != size; ++i) {
         // the box rect like ↓
         // 0 - 1
         // 3 - 2
         Rect rect;
         if (!without_det) {
-            int* box = m_boxes_buffer + i * 8;
+            int* box = engine->boxes_buffer + i * 8;
             int x_collect[4] = { *(box + 0), *(box + 2), *(box + 4), *(box + 6) };
             int y_collect[4] = { *(box + 1), *(box + 3), *(box + 5), *(box + 7) };
             auto [left, right] = ranges::minmax(x_collect);
             auto [top, bottom] = ranges::minmax(y_collect);
             rect = Rect(left, top, right - left, bottom - top);
         }
-        std::string text(*(m_strs_buffer + i));
-        float score = *(m_scores_buffer + i);
+        std::string text(*(engine->strs_buffer + i));
+        float score = *(engine->scores_buffer + i);
         if (score > 2.0) {
             score = 0;
         }
+        raw_result.emplace_back(score, rect, text);
+    }
+    return raw_result;
+}
 
-        TextRect tr { score, rect, text };
-#ifdef ASST_DEBUG
-        cv::rectangle(copied, make_rect<cv::Rect>(rect), cv::Scalar(0, 0, 255), 2);
-#endif
-        raw_result.emplace_back(tr);
-        if (trim) {
-            utils::string_trim(tr.text);
-        }
-        if (!pred || pred(tr)) {
-            result.emplace_back(std::move(tr));
-        }
+std::optional<std::vector<asst::TextRect>> asst::OcrPack::find_cache(uint64_t key)
+{
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    auto iter = m_cache_index.find(key);
+    if (iter == m_cache_index.cend()) {
+        ++m_cache_stats.misses;
+        return std::nullopt;
     }
+    ++m_cache_stats.hits;
+    // 移到最前面，表示最近用过
+    m_cache.splice(m_cache.begin(), m_cache, iter->second);
+    Log.trace("OcrPack::recognize | cache hit, hits:", m_cache_stats.hits, ", misses:", m_cache_stats.misses);
+    return iter->second->raw_result;
+}
 
-    Log.trace("OcrPack::recognize | raw:", raw_result);
-    Log.trace("OcrPack::recognize | proc:", result);
-    return result;
+void asst::OcrPack::insert_cache(uint64_t key, std::vector<TextRect> raw_result)
+{
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    if (m_cache_capacity == 0) {
+        return;
+    }
+    if (auto iter = m_cache_index.find(key); iter != m_cache_index.cend()) {
+        // 多个线程同时识别同一张图时可能已经有人插入过了
+        m_cache.splice(m_cache.begin(), m_cache, iter->second);
+        return;
+    }
+    m_cache.emplace_front(CacheEntry { key, std::move(raw_result) });
+    m_cache_index.emplace(key, m_cache.begin());
+    while (m_cache.size() > m_cache_capacity) {
+        m_cache_index.erase(m_cache.back().key);
+        m_cache.pop_back();
+    }
+}
+
+asst::OcrPack::CacheStats asst::OcrPack::get_cache_stats() const
+{
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    return m_cache_stats;
+}
+
+size_t asst::OcrPack::get_cache_capacity() const
+{
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    return m_cache_capacity;
+}
+
+void asst::OcrPack::set_cache_capacity(size_t capacity)
+{
+    std::unique_lock<std::mutex> lock(m_cache_mutex);
+    m_cache_capacity = capacity;
+    while (m_cache.size() > m_cache_capacity) {
+        m_cache_index.erase(m_cache.back().key);
+        m_cache.pop_back();
+    }
 }
 
 std::vector<asst::TextRect> asst::OcrPack::recognize(const cv::Mat& image, const Rect& roi,
@@ -159,13 +312,95 @@ std::vector<asst::TextRect> asst::OcrPack::recognize(const cv::Mat& image, const
             tr.rect.x += roi.x;
             tr.rect.y += roi.y;
         }
-        return pred(tr);
+        return !pred || pred(tr);
     };
     Log.trace("OcrPack::recognize | roi:", roi);
     cv::Mat roi_img = image(make_rect<cv::Rect>(roi));
     return recognize(roi_img, rect_cor, without_det, trim);
 }
 
+std::vector<std::vector<asst::TextRect>> asst::OcrPack::recognize_batch(const cv::Mat& image,
+                                                                       const std::vector<Rect>& rois,
+                                                                       const asst::TextRectProc& pred, bool trim)
+{
+    std::vector<std::vector<TextRect>> results(rois.size());
+    if (rois.size() <= 1) {
+        for (size_t i = 0; i != rois.size(); ++i) {
+            results[i] = recognize(image, rois[i], pred, true, trim);
+        }
+        return results;
+    }
+
+    const cv::Rect image_rect(0, 0, image.cols, image.rows);
+    std::vector<cv::Rect> cv_rois;
+    int max_width = 0;
+    int max_height = 0;
+    for (const Rect& roi : rois) {
+        const cv::Rect& cv_roi = cv_rois.emplace_back(make_rect<cv::Rect>(roi) & image_rect);
+        max_width = (std::max)(max_width, cv_roi.width);
+        max_height = (std::max)(max_height, cv_roi.height);
+    }
+    // 每个区域四周补上半个字高的边（复制区域边缘的背景色），检测模型才能把相邻的区域分开
+    const int padding = max_height / 2 + 1;
+    const int slot_width = max_width + 2 * padding;
+    const int slot_height = max_height + 2 * padding;
+    const size_t slots_per_canvas = static_cast<size_t>((std::max)(MaxBatchCanvasHeight / slot_height, 1));
+
+    std::vector<size_t> missed;
+    for (size_t begin = 0; begin < rois.size(); begin += slots_per_canvas) {
+        const size_t count = (std::min)(slots_per_canvas, rois.size() - begin);
+        cv::Mat canvas(static_cast<int>(count) * slot_height, slot_width, image.type(), cv::Scalar::all(0));
+        for (size_t i = 0; i != count; ++i) {
+            const cv::Rect& cv_roi = cv_rois[begin + i];
+            if (cv_roi.empty()) {
+                continue;
+            }
+            cv::Mat slot = canvas(cv::Rect(0, static_cast<int>(i) * slot_height, slot_width, slot_height));
+            cv::copyMakeBorder(image(cv_roi), slot, padding, slot_height - padding - cv_roi.height, padding,
+                               slot_width - padding - cv_roi.width, cv::BORDER_REPLICATE);
+        }
+
+        Log.trace("OcrPack::recognize_batch |", count, "rois, canvas:", canvas.cols, canvas.rows);
+        // 同一个区域里可能检测出好几段（比如数字和“万”分开了），按从左到右的顺序拼起来
+        std::vector<std::vector<TextRect>> slot_boxes(count);
+        for (TextRect& tr : recognize(canvas, nullptr, false, false)) {
+            const int center_y = tr.rect.y + tr.rect.height / 2;
+            const size_t slot_index = static_cast<size_t>((std::max)(center_y, 0) / slot_height);
+            if (slot_index < count) {
+                slot_boxes[slot_index].emplace_back(std::move(tr));
+            }
+        }
+        for (size_t i = 0; i != count; ++i) {
+            auto& boxes = slot_boxes[i];
+            if (boxes.empty()) {
+                missed.emplace_back(begin + i);
+                continue;
+            }
+            ranges::sort(boxes, std::less {}, [](const TextRect& tr) { return tr.rect.x; });
+            TextRect merged { boxes.front().score, rois[begin + i], std::string() };
+            for (const TextRect& box : boxes) {
+                merged.text += box.text;
+                merged.score = (std::min)(merged.score, box.score);
+            }
+            if (trim) {
+                utils::string_trim(merged.text);
+            }
+            if (!pred || pred(merged)) {
+                results[begin + i].emplace_back(std::move(merged));
+            }
+        }
+    }
+
+    // 拼起来之后检测不到的，再单独识别一次
+    if (!missed.empty()) {
+        Log.trace("OcrPack::recognize_batch | fallback to single recognize:", missed.size());
+    }
+    for (size_t index : missed) {
+        results[index] = recognize(image, rois[index], pred, true, trim);
+    }
+    return results;
+}
+
 #ifdef _WIN32
 
 static std::filesystem::path prepare_paddle_dir(const std::filesystem::path& dir, bool* is_temp)
@@ -1,14 +1,19 @@
 #pragma once
 #include "AbstractResource.h"
 
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include "Utils/AsstTypes.h"
+#include "Utils/NoWarningCVMat.h"
 
-namespace cv
-{
-    class Mat;
-}
 struct paddle_ocr_t;
 
 namespace asst
@@ -17,6 +22,8 @@ namespace asst
     {
     protected:
         static constexpr size_t MaxBoxSize = 256;
+        // 拼接的图过大会被 Paddle 的检测模型缩小，小字就检测不到了，所以拼接的图高度不超过这个值
+        static constexpr int MaxBatchCanvasHeight = 960;
 
     public:
         virtual ~OcrPack() override;
@@ -27,16 +34,74 @@ namespace asst
                                         bool without_det = false, bool trim = true);
         std::vector<TextRect> recognize(const cv::Mat& image, const Rect& roi, const TextRectProc& pred = nullptr,
                                         bool without_det = false, bool trim = true);
+        // 一次识别多个小区域（数字之类的单行文字）
+        // 各区域补边到同样大小后竖着拼成一张图，一次调用 Paddle 检测+识别完，再按位置把结果分回各个区域，
+        // 拼图里检测不到的区域再单独 without_det 地识别。检测可能把字拆开或者合并，所以结果不一定和
+        // 逐个区域 without_det 地识别一致，换用前先用 DebugTask 的 ocr_batch_compare 对比
+        // 返回值与 rois 一一对应，每个区域至多一个结果，rect 为区域本身
+        std::vector<std::vector<TextRect>> recognize_batch(const cv::Mat& image, const std::vector<Rect>& rois,
+                                                           const TextRectProc& pred = nullptr, bool trim = true);
+
+        struct CacheStats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+        };
+        CacheStats get_cache_stats() const;
+        size_t get_cache_capacity() const;
+        // 为 0 时不缓存，超出的部分会被丢弃
+        void set_cache_capacity(size_t capacity);
 
     protected:
         OcrPack();
 
-        paddle_ocr_t* m_ocr = nullptr;
+        // 一个 Paddle 引擎和它专用的输出缓冲区，同一时间只给一个调用者用
+        struct Engine
+        {
+            Engine();
+            Engine(const Engine&) = delete;
+            Engine(Engine&&) = delete;
+            ~Engine();
+
+            Engine& operator=(const Engine&) = delete;
+            Engine& operator=(Engine&&) = delete;
+
+            paddle_ocr_t* ocr = nullptr;
+
+            // each box has 8 value ( 4 points, x and y )
+            int boxes_buffer[MaxBoxSize * 8] = { 0 };
+            char* strs_buffer[MaxBoxSize] = { nullptr };
+            float scores_buffer[MaxBoxSize] = { 0 };
+            // 不连续的图（ROI）拷贝到这里再识别，尺寸不变时不用重新分配内存
+            cv::Mat scratch;
+        };
+
+        // 借出一个空闲的引擎，析构时自动归还；都在用时等待其他调用者归还，没有加载时返回空
+        std::shared_ptr<Engine> acquire_engine();
+        // 调用 Paddle 识别，返回 trim 和 pred 之前的原始结果
+        std::vector<TextRect> run_engine(const cv::Mat& image, bool without_det);
+
+        // 识别结果的 LRU 缓存，键为图像内容和是否检测的哈希。模型是每个 OcrPack 各自的，所以各存各的
+        // 菜单、按钮之类不变的文字，连续几帧、不同任务识别同一块区域时直接返回上次的结果
+        struct CacheEntry
+        {
+            uint64_t key = 0;
+            std::vector<TextRect> raw_result;
+        };
+        std::optional<std::vector<TextRect>> find_cache(uint64_t key);
+        void insert_cache(uint64_t key, std::vector<TextRect> raw_result);
+
+        // 引擎池，多个 Assistant 实例同时识别时各用各的引擎，大小见 config.json 的 ocrPoolSize
+        std::mutex m_pool_mutex;
+        std::condition_variable m_pool_cv;
+        std::vector<std::unique_ptr<Engine>> m_engines;
+        std::vector<Engine*> m_idle_engines;
 
-        // each box has 8 value ( 4 points, x and y )
-        int m_boxes_buffer[MaxBoxSize * 8] = { 0 };
-        char* m_strs_buffer[MaxBoxSize] = { nullptr };
-        float m_scores_buffer[MaxBoxSize] = { 0 };
+        mutable std::mutex m_cache_mutex;
+        size_t m_cache_capacity = 0;
+        std::list<CacheEntry> m_cache; // 最近用过的在前面
+        std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> m_cache_index;
+        CacheStats m_cache_stats;
     };
 
     class WordOcr final : public SingletonHolder<WordOcr>, public OcrPack
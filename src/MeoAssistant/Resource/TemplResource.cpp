@@ -67,7 +67,65 @@ const cv::Mat asst::TemplResource::get_templ(const std::string& key) const noexc
     }
 }
 
+const cv::Mat asst::TemplResource::get_templ_gray(const std::string& key)
+{
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    if (auto iter = m_templs_gray.find(key); iter != m_templs_gray.cend()) {
+        return iter->second;
+    }
+    cv::Mat templ = get_templ(key);
+    if (templ.empty()) {
+        return cv::Mat();
+    }
+    cv::Mat gray;
+    cv::cvtColor(templ, gray, cv::COLOR_BGR2GRAY);
+    m_templs_gray.emplace(key, gray);
+    return gray;
+}
+
+const cv::Mat asst::TemplResource::get_templ_mask(const std::string& key, std::pair<int, int> mask_range,
+                                                  bool with_close)
+{
+    const cv::Mat gray = get_templ_gray(key);
+    if (gray.empty()) {
+        return cv::Mat();
+    }
+
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    auto& masks = m_templs_mask[key];
+    for (const MaskCache& cache : masks) {
+        if (cache.mask_range == mask_range && cache.with_close == with_close) {
+            return cache.mask;
+        }
+    }
+    cv::Mat mask = make_mask(gray, mask_range, with_close);
+    masks.emplace_back(MaskCache { mask_range, with_close, mask });
+    return mask;
+}
+
+cv::Mat asst::TemplResource::make_mask(const cv::Mat& templ, std::pair<int, int> mask_range, bool with_close)
+{
+    cv::Mat mask;
+    if (templ.channels() == 1) {
+        cv::inRange(templ, mask_range.first, mask_range.second, mask);
+    }
+    else {
+        cv::cvtColor(templ, mask, cv::COLOR_BGR2GRAY);
+        cv::inRange(mask, mask_range.first, mask_range.second, mask);
+    }
+    if (with_close) {
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
+        cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel);
+    }
+    return mask;
+}
+
 void asst::TemplResource::insert_or_assign_templ(const std::string& key, cv::Mat&& templ)
 {
     m_templs.insert_or_assign(key, std::move(templ));
+
+    // 模板换了，之前生成的灰度图和掩码都作废
+    std::unique_lock<std::mutex> lock(m_derived_mutex);
+    m_templs_gray.erase(key);
+    m_templs_mask.erase(key);
 }
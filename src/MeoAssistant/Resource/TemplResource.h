@@ -3,8 +3,11 @@
 #include "AbstractResource.h"
 #include "Utils/SingletonHolder.hpp"
 
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "Utils/NoWarningCVMat.h"
 
@@ -20,13 +23,29 @@ namespace asst
 
         bool exist_templ(const std::string& key) const noexcept;
         const cv::Mat get_templ(const std::string& key) const noexcept;
+        // 模板的灰度图和掩码，第一次用到时生成，之后直接复用；返回的 Mat 只能读，不能修改
+        const cv::Mat get_templ_gray(const std::string& key);
+        const cv::Mat get_templ_mask(const std::string& key, std::pair<int, int> mask_range, bool with_close);
+        // 灰度在 mask_range 内的像素为 255，其余为 0；with_close 为 true 时再做一次闭运算，填上小的空洞
+        static cv::Mat make_mask(const cv::Mat& templ, std::pair<int, int> mask_range, bool with_close);
 
         void insert_or_assign_templ(const std::string& key, cv::Mat&& templ);
 
     private:
+        struct MaskCache
+        {
+            std::pair<int, int> mask_range;
+            bool with_close = false;
+            cv::Mat mask;
+        };
+
         std::unordered_set<std::string> m_templs_filename;
         std::unordered_map<std::string, cv::Mat> m_templs;
 
+        std::mutex m_derived_mutex;
+        std::unordered_map<std::string, cv::Mat> m_templs_gray;
+        std::unordered_map<std::string, std::vector<MaskCache>> m_templs_mask;
+
         bool m_loaded = false;
     };
 }
@@ -8,6 +8,7 @@
 #include "Resource/CopilotConfiger.h"
 #include "Resource/GeneralConfiger.h"
 #include "Resource/InfrastConfiger.h"
+#include "Resource/ItemIconIndex.h"
 #include "Resource/ItemConfiger.h"
 #include "Resource/OcrPack.h"
 #include "Resource/RecruitConfiger.h"
@@ -61,6 +62,8 @@ bool asst::ResourceLoader::load(const std::filesystem::path& path)
     LoadResourceWithTemplAndCheckRet(TaskData, "tasks.json"_p, "template"_p);
     LoadResourceWithTemplAndCheckRet(InfrastConfiger, "infrast.json"_p, "template"_p / "infrast"_p);
     LoadResourceWithTemplAndCheckRet(ItemConfiger, "item_index.json"_p, "template"_p / "items"_p);
+    // 材料模板加载完之后建立图标索引，识别仓库和掉落时用来筛选候选
+    ItemIconIndex::get_instance().build(ItemData.get_all_item_id());
 
     /* load 3rd parties resource */
     LoadResourceAndCheckRet(TilePack, "Arknights-Tile-Pos"_p / "levels.json"_p);
@@ -0,0 +1,259 @@
+#include "SessionRecorder.h"
+
+#include <cstring>
+
+#include "Utils/NoWarningCV.h"
+
+#include "Utils/ImageSignature.hpp"
+#include "Utils/Logger.hpp"
+
+void asst::session_archive::RecordHeader::serialize(char* buf) const
+{
+    // 目前支持的平台都是小端序，直接拷贝内存即可
+    buf[0] = static_cast<char>(type);
+    std::memcpy(buf + 1, &time, sizeof(time));
+    std::memcpy(buf + 9, &id, sizeof(id));
+    std::memcpy(buf + 17, &aux, sizeof(aux));
+    std::memcpy(buf + 25, &size, sizeof(size));
+}
+
+asst::session_archive::RecordHeader asst::session_archive::RecordHeader::deserialize(const char* buf)
+{
+    RecordHeader header;
+    header.type = static_cast<RecordType>(buf[0]);
+    std::memcpy(&header.time, buf + 1, sizeof(header.time));
+    std::memcpy(&header.id, buf + 9, sizeof(header.id));
+    std::memcpy(&header.aux, buf + 17, sizeof(header.aux));
+    std::memcpy(&header.size, buf + 25, sizeof(header.size));
+    return header;
+}
+
+std::unique_ptr<asst::SessionRecorder> asst::SessionRecorder::open(const std::filesystem::path& path)
+{
+    LogTraceFunction;
+    Log.info("start recording", path);
+
+    std::error_code ec;
+    if (path.has_parent_path()) {
+        std::filesystem::create_directories(path.parent_path(), ec);
+    }
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) {
+        Log.error("open record file failed", path);
+        return nullptr;
+    }
+    file.write(session_archive::Magic.data(), static_cast<std::streamsize>(session_archive::Magic.size()));
+    return std::unique_ptr<SessionRecorder>(new SessionRecorder(path, std::move(file)));
+}
+
+asst::SessionRecorder::SessionRecorder(std::filesystem::path path, std::ofstream file)
+    : m_path(std::move(path)), m_start_time(std::chrono::steady_clock::now()), m_file(std::move(file)),
+      m_offset(session_archive::Magic.size())
+{
+    m_thread = std::thread(&SessionRecorder::working_proc, this);
+}
+
+asst::SessionRecorder::~SessionRecorder()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_exit = true;
+        m_condvar.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (!m_failed) {
+        write_index();
+    }
+    m_file.close();
+    Log.info("stop recording", m_path, ", frames:", m_frame_count, ", unique:", m_unique_frame_count,
+             ", dropped:", m_dropped_frames, ", size:", m_offset);
+}
+
+void asst::SessionRecorder::add_frame(const cv::Mat& image, uint64_t seq, unsigned action_count)
+{
+    if (image.empty() || m_failed) {
+        return;
+    }
+    Item item;
+    item.type = session_archive::RecordType::Frame;
+    item.time = elapsed_ms();
+    item.id = seq;
+    item.aux = action_count;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queued_frames >= MaxQueuedFrames) {
+        if (m_dropped_frames++ == 0) {
+            Log.warn("SessionRecorder is too slow, drop frames");
+        }
+        return;
+    }
+    ++m_queued_frames;
+    lock.unlock();
+    if (image.u) {
+        // 自己持有内存的图（例如 PNG 解码出来的）共享引用计数即可，不用拷贝
+        item.image = image;
+    }
+    else {
+        // raw 截图直接引用接收数据的缓冲区，下一帧会复用这块内存，只能拷贝；拷贝到复用的缓冲区里，不用每帧分配
+        // 转换颜色、编码都留给后台线程
+        cv::Mat buf = m_frame_pool.acquire(image.size(), image.type());
+        image.copyTo(buf);
+        item.image = std::move(buf);
+    }
+    lock.lock();
+    m_queue.emplace_back(std::move(item));
+    m_condvar.notify_one();
+}
+
+void asst::SessionRecorder::add_action(unsigned id, std::string action)
+{
+    if (m_failed) {
+        return;
+    }
+    Item item;
+    item.type = session_archive::RecordType::Action;
+    item.time = elapsed_ms();
+    item.id = id;
+    item.text = std::move(action);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.emplace_back(std::move(item));
+    m_condvar.notify_one();
+}
+
+void asst::SessionRecorder::working_proc()
+{
+    LogTraceFunction;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condvar.wait(lock, [&]() -> bool { return m_exit || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            // 退出前要把队列中的数据都写完
+            break;
+        }
+        Item item = std::move(m_queue.front());
+        m_queue.pop_front();
+        if (item.type == session_archive::RecordType::Frame) {
+            --m_queued_frames;
+        }
+        lock.unlock();
+
+        if (!m_failed) {
+            write_item(item);
+        }
+    }
+}
+
+void asst::SessionRecorder::write_item(const Item& item)
+{
+    using namespace session_archive;
+
+    RecordHeader header;
+    header.time = item.time;
+    header.id = item.id;
+    header.aux = item.aux;
+
+    if (item.type == RecordType::Action) {
+        header.type = RecordType::Action;
+        header.size = static_cast<uint32_t>(item.text.size());
+        write_record(header, item.text.data());
+        return;
+    }
+
+    cv::Mat bgr;
+    if (item.image.type() == CV_8UC4) {
+        cv::cvtColor(item.image, bgr, cv::COLOR_RGBA2BGR);
+    }
+    else {
+        bgr = item.image;
+    }
+
+    ++m_frame_count;
+    uint64_t hash = utils::hash_image(bgr);
+    if (auto offset = find_same_frame(bgr, hash)) {
+        // 任务在同一个界面反复截图识别时，大部分截图是完全相同的，只记录引用
+        header.type = RecordType::FrameRef;
+        header.size = sizeof(uint64_t);
+        write_record(header, reinterpret_cast<const char*>(&offset.value()));
+        return;
+    }
+
+    // PNG 是无损的，用最快的压缩等级，尽量少占用 CPU
+    static const std::vector<int> EncodeParams = { cv::IMWRITE_PNG_COMPRESSION, 1 };
+    if (!cv::imencode(".png", bgr, m_encode_buffer, EncodeParams)) {
+        Log.error("SessionRecorder encode frame failed", item.id);
+        return;
+    }
+    ++m_unique_frame_count;
+    uint64_t offset = m_offset;
+    header.type = RecordType::Frame;
+    header.size = static_cast<uint32_t>(m_encode_buffer.size());
+    if (!write_record(header, reinterpret_cast<const char*>(m_encode_buffer.data()))) {
+        return;
+    }
+    m_recent_frames.emplace_front(RecentFrame { hash, offset, bgr });
+    if (m_recent_frames.size() > MaxRecentFrames) {
+        m_recent_frames.pop_back();
+    }
+}
+
+std::optional<uint64_t> asst::SessionRecorder::find_same_frame(const cv::Mat& image, uint64_t hash) const
+{
+    for (const RecentFrame& frame : m_recent_frames) {
+        if (frame.hash != hash || frame.image.size() != image.size() || frame.image.type() != image.type()) {
+            continue;
+        }
+        // 哈希相同不代表内容相同，逐像素确认一下
+        if (cv::norm(frame.image, image, cv::NORM_INF) == 0) {
+            return frame.offset;
+        }
+    }
+    return std::nullopt;
+}
+
+bool asst::SessionRecorder::write_record(const session_archive::RecordHeader& header, const char* payload)
+{
+    char buf[session_archive::RecordHeader::Size] = { 0 };
+    header.serialize(buf);
+    m_file.write(buf, sizeof(buf));
+    m_file.write(payload, header.size);
+    if (!m_file) {
+        // 写了一半的记录读取时会被丢弃，前面的记录仍然可以回放
+        Log.error("SessionRecorder write failed, stop recording", m_path);
+        m_failed = true;
+        return false;
+    }
+    m_index.emplace_back(m_offset);
+    m_offset += sizeof(buf) + header.size;
+    return true;
+}
+
+void asst::SessionRecorder::write_index()
+{
+    session_archive::RecordHeader header;
+    header.type = session_archive::RecordType::Index;
+    header.time = elapsed_ms();
+    header.size = static_cast<uint32_t>(m_index.size() * sizeof(uint64_t));
+
+    uint64_t index_offset = m_offset;
+    std::vector<uint64_t> index = std::move(m_index);
+    if (!write_record(header, reinterpret_cast<const char*>(index.data()))) {
+        return;
+    }
+    m_file.write(reinterpret_cast<const char*>(&index_offset), sizeof(index_offset));
+    m_file.write(session_archive::IndexMagic.data(), static_cast<std::streamsize>(session_archive::IndexMagic.size()));
+    m_file.flush();
+    if (!m_file) {
+        Log.error("SessionRecorder write index failed", m_path);
+        m_failed = true;
+    }
+}
+
+uint64_t asst::SessionRecorder::elapsed_ms() const
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now() - m_start_time).count());
+}
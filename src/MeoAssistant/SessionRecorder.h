@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Utils/FrameBufferPool.hpp"
+#include "Utils/NoWarningCVMat.h"
+
+namespace asst
+{
+    // 录制文件格式，所有整数均为小端序：
+    //   文件头   "MAAREC01"
+    //   记录     type(u8) time(u64, 距录制开始的毫秒数) id(u64) aux(u64) size(u32) payload(size 字节)
+    //     Frame    id 为截图序号，aux 为截图开始时已经执行完的操作数，payload 为 PNG
+    //     FrameRef 与之前某一帧完全相同，payload 为那一帧的 Frame 记录在文件中的偏移量(u64)
+    //     Action   id 为操作 id（即 click 等的返回值），payload 为操作描述，例如 "click 100 200"
+    //     Index    最后一条记录，payload 为之前所有记录的偏移量(u64 数组)
+    //   文件尾   Index 记录的偏移量(u64) "MAAIDX01"
+    // 录制中途崩溃时没有 Index 和文件尾，读取时从头依次扫描记录即可
+    namespace session_archive
+    {
+        inline constexpr std::string_view Magic = "MAAREC01";
+        inline constexpr std::string_view IndexMagic = "MAAIDX01";
+
+        enum class RecordType : uint8_t
+        {
+            Frame = 1,
+            FrameRef = 2,
+            Action = 3,
+            Index = 4,
+        };
+
+        struct RecordHeader
+        {
+            static constexpr size_t Size = 1 + 8 + 8 + 8 + 4;
+
+            RecordType type = RecordType::Frame;
+            uint64_t time = 0;
+            uint64_t id = 0;
+            uint64_t aux = 0;
+            uint32_t size = 0;
+
+            void serialize(char* buf) const;
+            static RecordHeader deserialize(const char* buf);
+        };
+    }
+
+    // 把截图和操作录制到一个文件中，供 ReplaySession 回放
+    // 编码和写文件都在后台线程进行，不会拖慢任务；后台来不及处理时会丢弃截图，但不会丢弃操作
+    // 写文件失败（例如磁盘满了）时停止录制，已经写入的部分仍然可以回放
+    class SessionRecorder
+    {
+    public:
+        static constexpr size_t MaxQueuedFrames = 4;
+        // 保留最近几张不重复的截图，哈希相同时比较内容，确认完全相同才只记录引用
+        static constexpr size_t MaxRecentFrames = 4;
+
+        SessionRecorder(const SessionRecorder&) = delete;
+        SessionRecorder(SessionRecorder&&) = delete;
+        // 写完队列中剩余的数据和索引后返回
+        ~SessionRecorder();
+
+        static std::unique_ptr<SessionRecorder> open(const std::filesystem::path& path);
+
+        // image 自己持有内存时直接共享（调用者之后不能原地修改它），否则拷贝到复用的缓冲区中
+        void add_frame(const cv::Mat& image, uint64_t seq, unsigned action_count);
+        void add_action(unsigned id, std::string action);
+
+        SessionRecorder& operator=(const SessionRecorder&) = delete;
+        SessionRecorder& operator=(SessionRecorder&&) = delete;
+
+    private:
+        struct Item
+        {
+            session_archive::RecordType type = session_archive::RecordType::Frame;
+            uint64_t time = 0;
+            uint64_t id = 0;
+            uint64_t aux = 0;
+            cv::Mat image;
+            std::string text;
+        };
+
+        SessionRecorder(std::filesystem::path path, std::ofstream file);
+
+        void working_proc();
+        void write_item(const Item& item);
+        bool write_record(const session_archive::RecordHeader& header, const char* payload);
+        std::optional<uint64_t> find_same_frame(const cv::Mat& image, uint64_t hash) const;
+        void write_index();
+        uint64_t elapsed_ms() const;
+
+        std::filesystem::path m_path;
+        std::chrono::steady_clock::time_point m_start_time;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condvar;
+        std::deque<Item> m_queue;
+        size_t m_queued_frames = 0;
+        size_t m_dropped_frames = 0;
+        bool m_exit = false;
+        std::atomic<bool> m_failed = false; // 写文件失败，不再接收新的数据
+        FrameBufferPool m_frame_pool { MaxQueuedFrames + 1 }; // 加上后台线程正在处理的那一张
+
+        // 以下只在后台线程中使用
+        std::ofstream m_file;
+        uint64_t m_offset = 0;
+        std::vector<uint64_t> m_index;
+        struct RecentFrame
+        {
+            uint64_t hash = 0;
+            uint64_t offset = 0; // Frame 记录的偏移量
+            cv::Mat image;
+        };
+        std::deque<RecentFrame> m_recent_frames; // 最近的在前面
+        std::vector<uchar> m_encode_buffer;
+        size_t m_frame_count = 0;
+        size_t m_unique_frame_count = 0;
+
+        std::thread m_thread;
+    };
+}
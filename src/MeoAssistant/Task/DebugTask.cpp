@@ -1,15 +1,31 @@
 #include "DebugTask.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <regex>
+#include <thread>
+
+#include <meojson/json.hpp>
 
 #include "Utils/NoWarningCV.h"
 
 // #include "Plugin/RoguelikeSkillSelectionTaskPlugin.h"
 
+#include "Controller.h"
 #include "ImageAnalyzer/DepotImageAnalyzer.h"
+#include "ImageAnalyzer/General/MatchImageAnalyzer.h"
 #include "ImageAnalyzer/StageDropsImageAnalyzer.h"
+#include "ReplaySession.h"
+#include "Resource/GeneralConfiger.h"
+#include "Resource/OcrPack.h"
+#include "Resource/TemplResource.h"
+#include "TaskData.h"
 #include "Utils/AsstImageIo.hpp"
 #include "Utils/Logger.hpp"
+#include "Utils/Platform.hpp"
+#include "Utils/TextReplacer.h"
 
 asst::DebugTask::DebugTask(const AsstCallback& callback, void* callback_arg)
     : PackageTask(callback, callback_arg, TaskType)
@@ -19,7 +35,45 @@ asst::DebugTask::DebugTask(const AsstCallback& callback, void* callback_arg)
     // m_subtasks.emplace_back(task_ptr);
 }
 
+bool asst::DebugTask::set_params(const json::value& params)
+{
+    m_pyramid_compare_path = params.get("pyramid_compare", std::string());
+    m_ocr_benchmark_path = params.get("ocr_benchmark", "frames", std::string());
+    m_ocr_benchmark_threads = (std::max)(params.get("ocr_benchmark", "threads", 1), 1);
+    m_ocr_benchmark_rounds = (std::max)(params.get("ocr_benchmark", "rounds", 1), 1);
+    m_ocr_benchmark_use_cache = params.get("ocr_benchmark", "cache", false);
+    m_ocr_replace_benchmark_rounds = params.get("ocr_replace_benchmark", 0);
+    m_ocr_batch_compare_path = params.get("ocr_batch_compare", std::string());
+    m_frame_alloc_benchmark_rounds = params.get("frame_alloc_benchmark", 0);
+    m_templ_mask_benchmark_rounds = params.get("templ_mask_benchmark", 0);
+    return true;
+}
+
 bool asst::DebugTask::run()
+{
+    if (!m_pyramid_compare_path.empty()) {
+        return compare_pyramid_match(utils::path(m_pyramid_compare_path));
+    }
+    if (!m_ocr_benchmark_path.empty()) {
+        return benchmark_ocr(utils::path(m_ocr_benchmark_path), m_ocr_benchmark_threads, m_ocr_benchmark_rounds,
+                             m_ocr_benchmark_use_cache);
+    }
+    if (m_ocr_replace_benchmark_rounds > 0) {
+        return benchmark_ocr_replace(m_ocr_replace_benchmark_rounds);
+    }
+    if (!m_ocr_batch_compare_path.empty()) {
+        return compare_ocr_batch(utils::path(m_ocr_batch_compare_path));
+    }
+    if (m_frame_alloc_benchmark_rounds > 0) {
+        return benchmark_frame_alloc(m_frame_alloc_benchmark_rounds);
+    }
+    if (m_templ_mask_benchmark_rounds > 0) {
+        return benchmark_templ_mask(m_templ_mask_benchmark_rounds);
+    }
+    return test_drops();
+}
+
+bool asst::DebugTask::test_drops()
 {
     size_t total = 0;
     size_t success = 0;
@@ -37,3 +91,426 @@ bool asst::DebugTask::run()
     Log.info(__FUNCTION__, success, "/", total);
     return true;
 }
+
+bool asst::DebugTask::compare_pyramid_match(const std::filesystem::path& frames_path)
+{
+    LogTraceFunction;
+
+    auto session = ReplaySession::open(frames_path);
+    if (!session) {
+        return false;
+    }
+
+    struct Stats
+    {
+        size_t matched = 0;         // 直接匹配识别到的次数
+        size_t pyramid_matched = 0; // 金字塔匹配识别到的次数
+        size_t mismatched = 0;      // 两种方式结果不一致（一个识别到一个没识别到，或者位置不同）的次数
+        double cost = 0;            // 直接匹配的总耗时，毫秒
+        double pyramid_cost = 0;
+    };
+    std::vector<std::string> tasks_name;
+    for (const std::string& name : Task.get_all_task_names()) {
+        if (auto task_ptr = Task.get(name); task_ptr && task_ptr->algorithm == AlgorithmType::MatchTemplate) {
+            tasks_name.emplace_back(name);
+        }
+    }
+    std::unordered_map<std::string, Stats> stats;
+
+    auto timed_match = [](MatchImageAnalyzer& analyzer, bool use_pyramid, double& cost) -> bool {
+        analyzer.set_use_pyramid(use_pyramid);
+        auto start = std::chrono::steady_clock::now();
+        bool ret = analyzer.analyze();
+        cost += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return ret;
+    };
+
+    for (size_t i = 0; i < session->frame_count() && !need_exit(); ++i) {
+        cv::Mat image = session->frame_at(i);
+        if (image.empty()) {
+            continue;
+        }
+        if (image.cols != WindowWidthDefault || image.rows != WindowHeightDefault) {
+            cv::resize(image, image, cv::Size(WindowWidthDefault, WindowHeightDefault), 0, 0, cv::INTER_AREA);
+        }
+        for (const std::string& name : tasks_name) {
+            Stats& cur = stats[name];
+            MatchImageAnalyzer analyzer(image);
+            analyzer.set_task_info(Task.get(name));
+            bool matched = timed_match(analyzer, false, cur.cost);
+            Rect rect = analyzer.get_result().rect;
+            bool pyramid_matched = timed_match(analyzer, true, cur.pyramid_cost);
+            Rect pyramid_rect = analyzer.get_result().rect;
+
+            cur.matched += matched;
+            cur.pyramid_matched += pyramid_matched;
+            if (matched != pyramid_matched ||
+                (matched && (std::abs(rect.x - pyramid_rect.x) > 1 || std::abs(rect.y - pyramid_rect.y) > 1))) {
+                ++cur.mismatched;
+                Log.warn("pyramid mismatch | frame:", i, ", task:", name, ", direct:", matched, rect,
+                         ", pyramid:", pyramid_matched, pyramid_rect);
+            }
+        }
+    }
+
+    std::vector<std::pair<std::string, Stats>> sorted(stats.begin(), stats.end());
+    std::ranges::sort(sorted, [](const auto& lhs, const auto& rhs) { return lhs.second.cost > rhs.second.cost; });
+    Stats total;
+    for (const auto& [name, cur] : sorted) {
+        Log.info("pyramid compare |", name, ", matched:", cur.matched, "/", cur.pyramid_matched,
+                 ", mismatched:", cur.mismatched, ", cost(ms):", cur.cost, "/", cur.pyramid_cost);
+        total.matched += cur.matched;
+        total.pyramid_matched += cur.pyramid_matched;
+        total.mismatched += cur.mismatched;
+        total.cost += cur.cost;
+        total.pyramid_cost += cur.pyramid_cost;
+    }
+    Log.info("pyramid compare | frames:", session->frame_count(), ", tasks:", tasks_name.size(),
+             ", matched:", total.matched, "/", total.pyramid_matched, ", mismatched:", total.mismatched,
+             ", cost(ms):", total.cost, "/", total.pyramid_cost);
+    return true;
+}
+
+bool asst::DebugTask::benchmark_ocr(const std::filesystem::path& frames_path, int threads, int rounds,
+                                    bool use_cache)
+{
+    LogTraceFunction;
+
+    auto session = ReplaySession::open(frames_path);
+    if (!session) {
+        return false;
+    }
+    std::vector<cv::Mat> frames;
+    for (size_t i = 0; i < session->frame_count(); ++i) {
+        cv::Mat image = session->frame_at(i);
+        if (image.empty()) {
+            continue;
+        }
+        if (image.cols != WindowWidthDefault || image.rows != WindowHeightDefault) {
+            cv::resize(image, image, cv::Size(WindowWidthDefault, WindowHeightDefault), 0, 0, cv::INTER_AREA);
+        }
+        frames.emplace_back(std::move(image));
+    }
+    if (frames.empty()) {
+        Log.error(__FUNCTION__, "no frames");
+        return false;
+    }
+
+    // 默认不用缓存，否则第二遍开始测的都是缓存
+    auto& ocr = WordOcr::get_instance();
+    const size_t cache_capacity = ocr.get_cache_capacity();
+    if (!use_cache) {
+        ocr.set_cache_capacity(0);
+    }
+    const auto cache_stats = ocr.get_cache_stats();
+
+    // 每个线程模拟一个实例，把所有截图整张识别 rounds 遍
+    std::atomic<size_t> calls = 0;
+    std::atomic<size_t> texts = 0;
+    std::vector<double> latency_sum(threads, 0.0); // 每个线程的识别总耗时，毫秒
+    auto worker = [&](int index) {
+        for (int round = 0; round < rounds && !need_exit(); ++round) {
+            for (const cv::Mat& frame : frames) {
+                auto start = std::chrono::steady_clock::now();
+                auto result = ocr.recognize(frame);
+                latency_sum[index] +=
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                ++calls;
+                texts += result.size();
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(worker, i);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ocr.set_cache_capacity(cache_capacity);
+    const size_t cache_hits = ocr.get_cache_stats().hits - cache_stats.hits;
+
+    double total_latency = 0;
+    for (double latency : latency_sum) {
+        total_latency += latency;
+    }
+    const size_t total_calls = calls;
+    Log.info("ocr benchmark | threads:", threads, ", pool size:", Configer.get_options().ocr_pool_size,
+             ", frames:", frames.size(), ", calls:", total_calls, ", texts:", static_cast<size_t>(texts),
+             ", elapsed(ms):", elapsed, ", calls/s:", total_calls * 1000.0 / elapsed,
+             ", avg latency(ms):", total_calls ? total_latency / total_calls : 0.0, ", cache hits:", cache_hits);
+    return true;
+}
+
+bool asst::DebugTask::benchmark_ocr_replace(int rounds)
+{
+    LogTraceFunction;
+
+    // 没有截图也能跑：用所有文字识别任务的 text 和替换规则本身凑出一批识别结果
+    std::vector<std::pair<std::string, std::shared_ptr<const TextReplacer>>> replacers;
+    std::vector<std::string> texts;
+    for (const std::string& name : Task.get_all_task_names()) {
+        auto task_ptr = Task.get<OcrTaskInfo>(name);
+        if (!task_ptr) {
+            continue;
+        }
+        texts.insert(texts.end(), task_ptr->text.cbegin(), task_ptr->text.cend());
+        if (!task_ptr->replace_map || task_ptr->replace_map->empty()) {
+            continue;
+        }
+        replacers.emplace_back(name, task_ptr->replace_map);
+        for (const auto& rule : task_ptr->replace_map->rules()) {
+            texts.emplace_back(rule.replacement);
+            if (rule.type == TextReplacer::RuleType::Literal) {
+                texts.emplace_back(rule.pattern);
+            }
+            else if (rule.type == TextReplacer::RuleType::Exact) {
+                texts.emplace_back(rule.pattern.substr(1, rule.pattern.size() - 2));
+            }
+        }
+    }
+    std::ranges::sort(texts);
+    texts.erase(std::unique(texts.begin(), texts.end()), texts.end());
+    if (replacers.empty() || texts.empty()) {
+        Log.error(__FUNCTION__, "no ocrReplace rules");
+        return false;
+    }
+
+    double total_cost = 0;          // 每次现编译正则的总耗时，微秒
+    double total_compiled_cost = 0; // 使用预编译规则的总耗时
+    size_t mismatched = 0;
+    for (const auto& [name, replacer] : replacers) {
+        double cost = 0;
+        double compiled_cost = 0;
+        for (int round = 0; round < rounds && !need_exit(); ++round) {
+            for (const std::string& text : texts) {
+                auto start = std::chrono::steady_clock::now();
+                std::string result = text;
+                for (const auto& rule : replacer->rules()) {
+                    result = std::regex_replace(result, std::regex(rule.pattern), rule.replacement);
+                }
+                auto mid = std::chrono::steady_clock::now();
+                std::string compiled_result = text;
+                replacer->apply(compiled_result);
+                auto end = std::chrono::steady_clock::now();
+
+                cost += std::chrono::duration<double, std::micro>(mid - start).count();
+                compiled_cost += std::chrono::duration<double, std::micro>(end - mid).count();
+                if (round == 0 && result != compiled_result) {
+                    ++mismatched;
+                    Log.warn("ocr replace mismatch |", name, ", text:", text, ", regex:", result,
+                             ", compiled:", compiled_result);
+                }
+            }
+        }
+        const double count = static_cast<double>(texts.size()) * rounds;
+        Log.info("ocr replace benchmark |", name, ", rules:", replacer->size(),
+                 ", avg cost per result(us):", cost / count, "/", compiled_cost / count);
+        total_cost += cost;
+        total_compiled_cost += compiled_cost;
+    }
+    const double count = static_cast<double>(texts.size()) * rounds * replacers.size();
+    Log.info("ocr replace benchmark | tasks:", replacers.size(), ", texts:", texts.size(), ", rounds:", rounds,
+             ", mismatched:", mismatched, ", avg cost per result(us):", total_cost / count, "/",
+             total_compiled_cost / count);
+    return true;
+}
+
+bool asst::DebugTask::compare_ocr_batch(const std::filesystem::path& frames_path)
+{
+    LogTraceFunction;
+
+    auto session = ReplaySession::open(frames_path);
+    if (!session) {
+        return false;
+    }
+
+    // 识别结果缓存会让第二遍直接命中，对比时关掉
+    const size_t word_cache_capacity = WordOcr::get_instance().get_cache_capacity();
+    const size_t char_cache_capacity = CharOcr::get_instance().get_cache_capacity();
+    WordOcr::get_instance().set_cache_capacity(0);
+    CharOcr::get_instance().set_cache_capacity(0);
+
+    struct Stats
+    {
+        size_t frames = 0;     // 两种方式都识别成功的截图数
+        size_t items = 0;      // 对比过的材料数
+        size_t mismatched = 0; // 材料或数量不一致的次数，包括只有一种方式识别成功的截图
+        double cost = 0;       // 逐个识别时 analyze 的总耗时，毫秒
+        double batch_cost = 0;
+    };
+    Stats depot;
+    Stats drops;
+
+    // 返回 <材料, 数量> 的列表，识别失败时为空
+    auto timed_analyze = [](auto& analyzer, bool use_batch, double& cost, auto&& get_items) {
+        analyzer.set_use_batch_ocr(use_batch);
+        auto start = std::chrono::steady_clock::now();
+        bool ret = analyzer.analyze();
+        cost += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::vector<std::pair<std::string, int>> items;
+        if (ret) {
+            items = get_items(analyzer);
+            std::ranges::sort(items);
+        }
+        return items;
+    };
+    auto compare = [](Stats& stats, size_t index, const std::string& name, const auto& items,
+                      const auto& batch_items) {
+        if (items.empty() && batch_items.empty()) {
+            return;
+        }
+        if (!items.empty() && !batch_items.empty()) {
+            ++stats.frames;
+        }
+        stats.items += (std::max)(items.size(), batch_items.size());
+        if (items == batch_items) {
+            return;
+        }
+        ++stats.mismatched;
+        std::string detail;
+        for (const auto& [item_id, quantity] : items) {
+            detail += item_id + ":" + std::to_string(quantity) + " ";
+        }
+        detail += "/ ";
+        for (const auto& [item_id, quantity] : batch_items) {
+            detail += item_id + ":" + std::to_string(quantity) + " ";
+        }
+        Log.warn("ocr batch mismatch | frame:", index, ",", name, ", single / batch:", detail);
+    };
+
+    auto depot_items = [](const DepotImageAnalyzer& analyzer) {
+        std::vector<std::pair<std::string, int>> items;
+        for (const auto& [item_id, info] : analyzer.get_result()) {
+            items.emplace_back(item_id, info.quantity);
+        }
+        return items;
+    };
+    auto drop_items = [](const StageDropsImageAnalyzer& analyzer) {
+        std::vector<std::pair<std::string, int>> items;
+        for (const StageDropInfo& info : analyzer.get_drops()) {
+            items.emplace_back(info.item_id, info.quantity);
+        }
+        return items;
+    };
+
+    for (size_t i = 0; i < session->frame_count() && !need_exit(); ++i) {
+        cv::Mat image = session->frame_at(i);
+        if (image.empty()) {
+            continue;
+        }
+        if (image.cols != WindowWidthDefault || image.rows != WindowHeightDefault) {
+            cv::resize(image, image, cv::Size(WindowWidthDefault, WindowHeightDefault), 0, 0, cv::INTER_AREA);
+        }
+        {
+            DepotImageAnalyzer analyzer(image);
+            auto items = timed_analyze(analyzer, false, depot.cost, depot_items);
+            DepotImageAnalyzer batch_analyzer(image);
+            auto batch_items = timed_analyze(batch_analyzer, true, depot.batch_cost, depot_items);
+            compare(depot, i, "depot", items, batch_items);
+        }
+        {
+            StageDropsImageAnalyzer analyzer(image);
+            auto items = timed_analyze(analyzer, false, drops.cost, drop_items);
+            StageDropsImageAnalyzer batch_analyzer(image);
+            auto batch_items = timed_analyze(batch_analyzer, true, drops.batch_cost, drop_items);
+            compare(drops, i, "drops", items, batch_items);
+        }
+    }
+
+    WordOcr::get_instance().set_cache_capacity(word_cache_capacity);
+    CharOcr::get_instance().set_cache_capacity(char_cache_capacity);
+
+    for (const auto& [name, cur] : { std::pair { "depot", depot }, std::pair { "drops", drops } }) {
+        Log.info("ocr batch compare |", name, ", frames:", cur.frames, ", items:", cur.items,
+                 ", mismatched:", cur.mismatched, ", cost(ms) single / batch:", cur.cost, "/", cur.batch_cost);
+    }
+    return true;
+}
+
+bool asst::DebugTask::benchmark_frame_alloc(int rounds)
+{
+    LogTraceFunction;
+
+    if (!m_ctrler || !m_ctrler->inited()) {
+        Log.error(__FUNCTION__, "controller not connected");
+        return false;
+    }
+
+    // 先截一张，把池子填上，之后稳定运行时每帧应当不再分配
+    m_ctrler->get_image_after(std::chrono::steady_clock::now());
+    const size_t alloc_before = m_ctrler->get_frame_alloc_count();
+
+    size_t frames = 0;
+    size_t empty_frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds && !need_exit(); ++i) {
+        cv::Mat image = m_ctrler->get_image_after(std::chrono::steady_clock::now());
+        ++frames;
+        empty_frames += image.empty();
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const size_t allocs = m_ctrler->get_frame_alloc_count() - alloc_before;
+
+    Log.info("frame alloc benchmark | frames:", frames, ", empty:", empty_frames, ", allocations:", allocs,
+             ", per frame:", frames ? static_cast<double>(allocs) / frames : 0.0,
+             ", avg cost(ms):", frames ? elapsed / frames : 0.0,
+             ", screencap:", m_ctrler->get_screencap_stats().get("method", std::string()));
+    return true;
+}
+
+bool asst::DebugTask::benchmark_templ_mask(int rounds)
+{
+    LogTraceFunction;
+
+    auto& templ_res = TemplResource::get_instance();
+    std::vector<std::shared_ptr<MatchTaskInfo>> tasks;
+    for (const std::string& name : Task.get_all_task_names()) {
+        auto task_ptr = Task.get<MatchTaskInfo>(name);
+        if (!task_ptr || (task_ptr->mask_range.first == 0 && task_ptr->mask_range.second == 0) ||
+            !templ_res.exist_templ(task_ptr->templ_name)) {
+            continue;
+        }
+        tasks.emplace_back(std::move(task_ptr));
+    }
+    if (tasks.empty()) {
+        Log.error(__FUNCTION__, "no tasks with maskRange");
+        return false;
+    }
+
+    // 与 MatchImageAnalyzer 一致：现生成时用彩色模板，缓存时用灰度图
+    double total_cost = 0;        // 每次现生成掩码的总耗时，微秒
+    double total_cached_cost = 0; // 使用缓存掩码的总耗时
+    size_t mismatched = 0;
+    for (const auto& task_ptr : tasks) {
+        const cv::Mat templ = templ_res.get_templ(task_ptr->templ_name);
+        double cost = 0;
+        double cached_cost = 0;
+        for (int round = 0; round < rounds && !need_exit(); ++round) {
+            auto start = std::chrono::steady_clock::now();
+            cv::Mat mask = TemplResource::make_mask(templ, task_ptr->mask_range, false);
+            auto mid = std::chrono::steady_clock::now();
+            const cv::Mat cached_mask = templ_res.get_templ_mask(task_ptr->templ_name, task_ptr->mask_range, false);
+            auto end = std::chrono::steady_clock::now();
+
+            cost += std::chrono::duration<double, std::micro>(mid - start).count();
+            cached_cost += std::chrono::duration<double, std::micro>(end - mid).count();
+            if (round == 0 && (mask.size() != cached_mask.size() || cv::countNonZero(mask != cached_mask) != 0)) {
+                ++mismatched;
+                Log.warn("templ mask mismatch |", task_ptr->name, ", templ:", task_ptr->templ_name);
+            }
+        }
+        Log.info("templ mask benchmark |", task_ptr->name, ", templ:", task_ptr->templ_name, ", size:", templ.cols,
+                 "x", templ.rows, ", avg cost per match(us):", cost / rounds, "/", cached_cost / rounds);
+        total_cost += cost;
+        total_cached_cost += cached_cost;
+    }
+    const double count = static_cast<double>(tasks.size()) * rounds;
+    Log.info("templ mask benchmark | tasks:", tasks.size(), ", rounds:", rounds, ", mismatched:", mismatched,
+             ", avg cost per match(us):", total_cost / count, "/", total_cached_cost / count);
+    return true;
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include "PackageTask.h"
 
+#include <filesystem>
+#include <string>
+
 namespace asst
 {
     class DebugTask : public PackageTask
@@ -10,7 +13,40 @@ namespace asst
         virtual ~DebugTask() override = default;
 
         virtual bool run() override;
+        // pyramid_compare: 录制的截图（目录或录制文件，见 ReplaySession），
+        // 设置后改为在这些截图上对比所有模板匹配任务开启、关闭金字塔匹配时的结果和耗时
+        // ocr_benchmark: { "frames": 录制的截图, "threads": 并发数, "rounds": 每个线程识别几遍所有截图,
+        //                 "cache": 是否使用识别结果缓存，默认不用 }，
+        // 设置后改为测试多个线程同时识别文字时的吞吐量
+        // ocr_replace_benchmark: 重复几遍，设置后改为对比每次现编译正则和使用预编译规则时，
+        // 所有 ocrReplace 规则处理一条识别结果的耗时
+        // ocr_batch_compare: 录制的截图（仓库或关卡结算界面），设置后改为对比仓库识别和掉落识别中
+        // 材料数量逐个识别和拼图批量识别（config.json 的 ocrBatch）的结果和耗时
+        // frame_alloc_benchmark: 截图次数，设置后改为在当前连接的设备上连续截图，
+        // 统计每帧截图平均分配了几次大块内存（FrameBufferPool）和耗时
+        // templ_mask_benchmark: 重复几遍，设置后改为对比所有设置了 maskRange 的任务
+        // 每次匹配现生成掩码和使用 TemplResource 中缓存的掩码的耗时
+        virtual bool set_params(const json::value& params) override;
 
         static constexpr const char* TaskType = "Debug";
+
+    private:
+        bool test_drops();
+        bool compare_pyramid_match(const std::filesystem::path& frames_path);
+        bool benchmark_ocr(const std::filesystem::path& frames_path, int threads, int rounds, bool use_cache);
+        bool benchmark_ocr_replace(int rounds);
+        bool compare_ocr_batch(const std::filesystem::path& frames_path);
+        bool benchmark_frame_alloc(int rounds);
+        bool benchmark_templ_mask(int rounds);
+
+        std::string m_pyramid_compare_path;
+        std::string m_ocr_benchmark_path;
+        int m_ocr_benchmark_threads = 1;
+        int m_ocr_benchmark_rounds = 1;
+        bool m_ocr_benchmark_use_cache = false;
+        int m_ocr_replace_benchmark_rounds = 0;
+        std::string m_ocr_batch_compare_path;
+        int m_frame_alloc_benchmark_rounds = 0;
+        int m_templ_mask_benchmark_rounds = 0;
     };
 }
@@ -39,6 +39,8 @@ bool asst::ProcessTask::run()
     }
 
     m_cur_tasks_name = m_raw_tasks_name;
+    m_image_after = std::chrono::steady_clock::now();
+    m_miss_signature = std::nullopt;
     for (m_cur_retry = 0; m_cur_retry <= m_retry_times; ++m_cur_retry) {
         if (_run()) {
             return true;
@@ -46,6 +48,8 @@ bool asst::ProcessTask::run()
         if (need_exit()) {
             return false;
         }
+        // 重试时要识别这之后的画面，否则没有新的操作时会一直拿到上一次识别失败的那张图
+        m_image_after = std::chrono::steady_clock::now();
         sleep(m_task_delay);
     }
     callback(AsstMsg::SubTaskError, basic_info());
@@ -160,19 +164,32 @@ bool ProcessTask::_run()
         }
 
         Rect rect;
+        cv::Mat image;
         // 如果第一个任务是JustReturn的，那就没必要再截图并计算了
         if (front_task_ptr->algorithm == AlgorithmType::JustReturn) {
             m_cur_task_ptr = front_task_ptr;
         }
         else {
-            const auto image = m_ctrler->get_image();
+            // 识别失败重试时，可以直接使用后台预先截好的图
+            image = m_ctrler->get_image_after(m_image_after);
             ProcessTaskImageAnalyzer analyzer(image, m_cur_tasks_name);
 
             analyzer.set_status(m_status);
 
+            // 签名只是缩小后的图的哈希，为防止漏掉细微的变化，连续跳过几次后仍然完整识别一次
+            static constexpr int MaxMissReusedTimes = 5;
+            uint64_t signature = analyzer.calc_signature();
+            if (m_miss_signature == signature && m_miss_reused_times < MaxMissReusedTimes) {
+                ++m_miss_reused_times;
+                Log.trace("Screen unchanged since last miss, skip analyzing");
+                return false;
+            }
             if (!analyzer.analyze()) {
+                m_miss_signature = signature;
+                m_miss_reused_times = 0;
                 return false;
             }
+            m_miss_signature = std::nullopt;
             m_cur_task_ptr = analyzer.get_result();
             rect = analyzer.get_rect();
         }
@@ -218,8 +235,10 @@ bool ProcessTask::_run()
 
         callback(AsstMsg::SubTaskStart, info);
 
-        // 前置固定延时
-        if (!sleep(m_cur_task_ptr->pre_delay)) {
+        // 前置延时。等待稳定时从操作前的画面开始算，等待变化时与识别用的截图比较
+        const auto pre_wait = m_cur_task_ptr->pre_wait;
+        const cv::Mat pre_reference = pre_wait == ScreenWaitType::Changed ? image : cv::Mat();
+        if (!delay_or_wait(pre_wait, m_cur_task_ptr->pre_delay, pre_reference)) {
             return false;
         }
 
@@ -271,12 +290,13 @@ bool ProcessTask::_run()
             }
         }
 
-        // 后置固定延时
+        // 后置延时
         int rear_delay = m_cur_task_ptr->rear_delay;
         if (auto iter = m_rear_delay.find(cur_name); iter != m_rear_delay.cend()) {
             rear_delay = iter->second;
         }
-        if (!sleep(rear_delay)) {
+        // 等待画面时与识别用的截图比较，操作生效前截到的图不会被当成稳定的画面
+        if (!delay_or_wait(m_cur_task_ptr->rear_wait, rear_delay, image)) {
             return false;
         }
 
@@ -293,6 +313,7 @@ bool ProcessTask::_run()
         }
 
         callback(AsstMsg::SubTaskCompleted, info);
+        m_image_after = std::chrono::steady_clock::now();
 
         if (limit_type == TimesLimitType::Post && exec_times >= max_times) {
             info["what"] = "ExceededLimit";
@@ -323,6 +344,16 @@ bool ProcessTask::_run()
     return true;
 }
 
+bool asst::ProcessTask::delay_or_wait(ScreenWaitType wait, int delay, const cv::Mat& reference)
+{
+    if (wait == ScreenWaitType::None || delay <= 0) {
+        return sleep(delay);
+    }
+    // 等不到也继续执行，和固定延时的行为一致，只是画面就绪时能提前结束
+    m_ctrler->wait_for_screen(wait, m_cur_task_ptr->wait_roi, delay, reference);
+    return !need_exit();
+}
+
 bool asst::ProcessTask::on_run_fails()
 {
     LogTraceFunction;
@@ -3,6 +3,10 @@
 #include "AbstractTask.h"
 #include "Utils/AsstTypes.h"
 
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
 namespace asst
 {
     // 流程任务，按照配置文件里的设置的流程运行
@@ -46,6 +50,8 @@ namespace asst
         void exec_click_task(const Rect& matched_rect);
         void exec_swipe_task(ProcessTaskAction action);
         void exec_slowly_swipe_task(ProcessTaskAction action);
+        // wait 为 None 时固定延时 delay 毫秒，否则等待画面变化或稳定，delay 为最长等待时间
+        bool delay_or_wait(ScreenWaitType wait, int delay, const cv::Mat& reference);
 
         std::shared_ptr<TaskInfo> m_cur_task_ptr = nullptr;
         std::vector<std::string> m_raw_tasks_name;
@@ -56,5 +62,10 @@ namespace asst
         std::unordered_map<std::string, int> m_exec_times;
         static constexpr int TaskDelayUnsetted = -1;
         int m_task_delay = TaskDelayUnsetted;
+        // 识别用的截图不能早于这个时间：任务开始、上一次识别失败，或者上一个任务的操作、延时、子任务都执行完
+        std::chrono::steady_clock::time_point m_image_after;
+        // 上次识别失败时的画面签名。画面和待识别的任务都没变时，结果必然还是失败，直接跳过识别
+        std::optional<uint64_t> m_miss_signature;
+        int m_miss_reused_times = 0;
     };
 }
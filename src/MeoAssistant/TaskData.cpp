@@ -9,12 +9,23 @@
 #include "Utils/AsstTypes.h"
 #include "Utils/Logger.hpp"
 #include "Utils/StringMisc.hpp"
+#include "Utils/TextReplacer.h"
 
 const std::unordered_set<std::string>& asst::TaskData::get_templ_required() const noexcept
 {
     return m_templ_required;
 }
 
+std::vector<std::string> asst::TaskData::get_all_task_names() const
+{
+    std::vector<std::string> names;
+    names.reserve(m_all_tasks_info.size());
+    for (const std::string& name : m_all_tasks_info | views::keys) {
+        names.emplace_back(name);
+    }
+    return names;
+}
+
 bool asst::TaskData::parse(const json::value& json)
 {
     LogTraceFunction;
@@ -208,6 +219,9 @@ std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_task_info(const std::st
         Log.error("Unknown algorithm in task", name);
         return nullptr;
     }
+    if (task_info_ptr == nullptr) {
+        return nullptr;
+    }
 
     // 不管什么algorithm，都有基础成员（next, roi, 等等）
     if (!append_base_task_info(task_info_ptr, name, task_json, default_ptr, task_prefix)) {
@@ -241,10 +255,11 @@ std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_match_task_info(const s
     else {
         match_task_info_ptr->mask_range = default_ptr->mask_range;
     }
+    match_task_info_ptr->pyramid = task_json.get("pyramid", default_ptr->pyramid);
     return match_task_info_ptr;
 }
 
-std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_ocr_task_info([[maybe_unused]] const std::string& name,
+std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_ocr_task_info(const std::string& name,
                                                                        const json::value& task_json,
                                                                        std::shared_ptr<OcrTaskInfo> default_ptr)
 {
@@ -269,9 +284,14 @@ std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_ocr_task_info([[maybe_u
 
     ocr_task_info_ptr->full_match = task_json.get("fullMatch", default_ptr->full_match);
     if (auto opt = task_json.find<json::array>("ocrReplace")) {
+        auto replacer = std::make_shared<TextReplacer>();
         for (const json::value& rep : opt.value()) {
-            ocr_task_info_ptr->replace_map.emplace(rep[0].as_string(), rep[1].as_string());
+            if (!replacer->add(rep[0].as_string(), rep[1].as_string())) {
+                Log.error("Ocr task", name, "has invalid ocrReplace regex:", rep[0].as_string());
+                return nullptr;
+            }
         }
+        ocr_task_info_ptr->replace_map = std::move(replacer);
     }
     else {
         ocr_task_info_ptr->replace_map = default_ptr->replace_map;
@@ -279,7 +299,7 @@ std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_ocr_task_info([[maybe_u
     return ocr_task_info_ptr;
 }
 
-std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_hash_task_info([[maybe_unused]] const std::string& name,
+std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_hash_task_info(const std::string& name,
                                                                         const json::value& task_json,
                                                                         std::shared_ptr<HashTaskInfo> default_ptr)
 {
@@ -288,8 +308,14 @@ std::shared_ptr<asst::TaskInfo> asst::TaskData::generate_hash_task_info([[maybe_
     }
     auto hash_task_info_ptr = std::make_shared<HashTaskInfo>();
     if (auto opt = task_json.find<json::array>("hash")) {
+        // 加载时就转换成二进制，识别时不用再解析字符串
         for (const json::value& hash : opt.value()) {
-            hash_task_info_ptr->hashes.emplace_back(hash.as_string());
+            auto hash_opt = image_hash_from_string(hash.as_string());
+            if (!hash_opt) {
+                Log.error("Invalid hash:", hash.as_string(), ", Task:", name);
+                return nullptr;
+            }
+            hash_task_info_ptr->hashes.emplace_back(*hash_opt);
         }
     }
     else {
@@ -355,6 +381,31 @@ bool asst::TaskData::append_base_task_info(std::shared_ptr<TaskInfo> task_info_p
     }
     task_info_ptr->pre_delay = task_json.get("preDelay", default_ptr->pre_delay);
     task_info_ptr->rear_delay = task_json.get("rearDelay", default_ptr->rear_delay);
+    auto parse_wait = [&](const std::string& key, ScreenWaitType& wait, ScreenWaitType default_wait) -> bool {
+        if (auto opt = task_json.find<std::string>(key)) {
+            wait = get_screen_wait_type(opt.value());
+            if (wait == ScreenWaitType::Invalid) [[unlikely]] {
+                Log.error("Unknown", key, ":", opt.value(), ", Task:", name);
+                return false;
+            }
+        }
+        else {
+            wait = default_wait;
+        }
+        return true;
+    };
+    if (!parse_wait("preWait", task_info_ptr->pre_wait, default_ptr->pre_wait) ||
+        !parse_wait("rearWait", task_info_ptr->rear_wait, default_ptr->rear_wait)) {
+        return false;
+    }
+    if (auto opt = task_json.find<json::array>("waitRoi")) {
+        auto& roi_arr = *opt;
+        task_info_ptr->wait_roi = Rect(static_cast<int>(roi_arr[0]), static_cast<int>(roi_arr[1]),
+                                       static_cast<int>(roi_arr[2]), static_cast<int>(roi_arr[3]));
+    }
+    else {
+        task_info_ptr->wait_roi = default_ptr->wait_roi;
+    }
     if (auto opt = task_json.find<json::array>("reduceOtherTimes")) {
         for (const json::value& reduce : opt.value()) {
             task_info_ptr->reduce_other_times.emplace_back(reduce.as_string());
@@ -426,6 +477,7 @@ std::shared_ptr<asst::MatchTaskInfo> asst::TaskData::_default_match_task_info()
     match_task_info_ptr->templ_name = "__INVALID__";
     match_task_info_ptr->templ_threshold = TemplThresholdDefault;
     match_task_info_ptr->special_threshold = 0;
+    match_task_info_ptr->pyramid = false;
 
     return match_task_info_ptr;
 }
@@ -485,12 +537,16 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
               "onErrorNext",
               "preDelay",
               "rearDelay",
+              "preWait",
+              "rearWait",
+              "waitRoi",
               "roi",
               "cache",
               "rectMove",
               "reduceOtherTimes",
               "templThreshold",
               "maskRange",
+              "pyramid",
               "fullMatch",
               "ocrReplace",
               "hash",
@@ -511,12 +567,16 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
               "onErrorNext",
               "preDelay",
               "rearDelay",
+              "preWait",
+              "rearWait",
+              "waitRoi",
               "roi",
               "cache",
               "rectMove",
               "reduceOtherTimes",
               "templThreshold",
               "maskRange",
+              "pyramid",
           } },
         { AlgorithmType::OcrDetect,
           {
@@ -532,6 +592,9 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
               "onErrorNext",
               "preDelay",
               "rearDelay",
+              "preWait",
+              "rearWait",
+              "waitRoi",
               "roi",
               "cache",
               "rectMove",
@@ -552,6 +615,9 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
               "onErrorNext",
               "preDelay",
               "rearDelay",
+              "preWait",
+              "rearWait",
+              "waitRoi",
               "reduceOtherTimes",
           } },
         { AlgorithmType::Hash,
@@ -567,6 +633,9 @@ bool asst::TaskData::syntax_check(const std::string& task_name, const json::valu
               "onErrorNext",
               "preDelay",
               "rearDelay",
+              "preWait",
+              "rearWait",
+              "waitRoi",
               "roi",
               "cache",
               "rectMove",
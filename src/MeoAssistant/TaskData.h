@@ -107,6 +107,8 @@ namespace asst
     public:
         virtual ~TaskData() override = default;
         virtual const std::unordered_set<std::string>& get_templ_required() const noexcept override;
+        // 所有已生成的任务名，还没用到过的 `@` 型任务不在其中
+        std::vector<std::string> get_all_task_names() const;
 
         template <typename TargetTaskInfoType = TaskInfo>
         requires(std::derived_from<TargetTaskInfoType, TaskInfo> ||
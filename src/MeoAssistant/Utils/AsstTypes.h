@@ -1,10 +1,15 @@
 #pragma once
 
+#include <array>
 #include <climits>
 #include <cmath>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -328,10 +333,69 @@ namespace asst
         }
         return "Invalid";
     }
+
+    // 执行任务前后如何等待画面
+    enum class ScreenWaitType
+    {
+        Invalid = -1,
+        None,    // 不看画面，固定延时
+        Changed, // 画面发生变化后立即返回
+        Stable,  // 画面不再变化后返回
+    };
+
+    inline ScreenWaitType get_screen_wait_type(std::string wait_str)
+    {
+        utils::tolowers(wait_str);
+        static const std::unordered_map<std::string, ScreenWaitType> wait_map = {
+            { "", ScreenWaitType::None },
+            { "none", ScreenWaitType::None },
+            { "changed", ScreenWaitType::Changed },
+            { "stable", ScreenWaitType::Stable },
+        };
+        if (auto it = wait_map.find(wait_str); it != wait_map.end()) {
+            return it->second;
+        }
+        return ScreenWaitType::Invalid;
+    }
+
+    // 图像哈希：缩放到 16x16 的二值图，每个像素一位，按行优先从高位到低位依次存进 4 个 64 位整数
+    using ImageHash = std::array<uint64_t, 4>;
+
+    // 十六进制字符串形式的哈希（tasks.json 中的写法），不足 64 位的在前面补 0
+    inline std::optional<ImageHash> image_hash_from_string(std::string_view hex)
+    {
+        static constexpr size_t HexLength = sizeof(ImageHash) * 2;
+        if (hex.size() > HexLength) {
+            return std::nullopt;
+        }
+        ImageHash hash {};
+        const size_t padding = HexLength - hex.size();
+        for (size_t i = 0; i < hex.size(); ++i) {
+            const char ch = hex[i];
+            uint64_t nibble = 0;
+            if ('0' <= ch && ch <= '9') {
+                nibble = ch - '0';
+            }
+            else if ('a' <= ch && ch <= 'f') {
+                nibble = ch - 'a' + 10;
+            }
+            else if ('A' <= ch && ch <= 'F') {
+                nibble = ch - 'A' + 10;
+            }
+            else {
+                return std::nullopt;
+            }
+            const size_t pos = padding + i;
+            hash[pos / 16] |= nibble << ((15 - pos % 16) * 4);
+        }
+        return hash;
+    }
 }
 
 namespace asst
 {
+    class TextReplacer;
+
     // 任务信息
     struct TaskInfo
     {
@@ -358,6 +422,11 @@ namespace asst
         Rect specific_rect;        // 指定区域，目前仅针对ClickRect任务有用，会点这个区域
         int pre_delay = 0;         // 执行该任务前的延时
         int rear_delay = 0;        // 执行该任务后的延时
+        ScreenWaitType pre_wait =  // 执行该任务前等待画面的方式，不为 None 时 pre_delay 为最长等待时间
+            ScreenWaitType::None;
+        ScreenWaitType rear_wait = // 执行该任务后等待画面的方式，不为 None 时 rear_delay 为最长等待时间
+            ScreenWaitType::None;
+        Rect wait_roi;             // 等待画面时比较的区域，若为0则比较全图
         int retry_times = INT_MAX; // 未找到图像时的重试次数
         Rect roi;                  // 要识别的区域，若为0则全图识别
         Rect rect_move;     // 识别结果移动：有些结果识别到的，和要点击的不是同一个位置。
@@ -376,8 +445,8 @@ namespace asst
         OcrTaskInfo& operator=(OcrTaskInfo&&) noexcept = default;
         std::vector<std::string> text; // 文字的容器，匹配到这里面任一个，就算匹配上了
         bool full_match = false;       // 是否需要全匹配，否则搜索到子串就算匹配上了
-        std::unordered_map<std::string, std::string>
-            replace_map; // 部分文字容易识别错，字符串强制replace之后，再进行匹配
+        // 部分文字容易识别错，字符串强制replace之后，再进行匹配。解析任务时编译好，派生的任务共用同一份
+        std::shared_ptr<const TextReplacer> replace_map;
     };
 
     // 图片匹配任务的信息
@@ -393,6 +462,7 @@ namespace asst
         double templ_threshold = 0;     // 模板匹配阈值
         double special_threshold = 0;   // 某些任务使用的特殊的阈值
         std::pair<int, int> mask_range; // 掩码的二值化范围
+        bool pyramid = false;           // 是否先在缩小的图上粗匹配，再在原图上只精确匹配候选位置
     };
 
     // hash 计算任务的信息
@@ -404,9 +474,9 @@ namespace asst
         HashTaskInfo(HashTaskInfo&&) noexcept = default;
         HashTaskInfo& operator=(const HashTaskInfo&) = default;
         HashTaskInfo& operator=(HashTaskInfo&&) noexcept = default;
-        std::vector<std::string> hashes; // 需要多个哈希值
-        int dist_threshold = 0;          // 汉明距离阈值
-        std::pair<int, int> mask_range;  // 掩码的二值化范围
-        bool bound = false;              // 是否裁剪周围黑边
+        std::vector<ImageHash> hashes;  // 需要多个哈希值
+        int dist_threshold = 0;         // 汉明距离阈值
+        std::pair<int, int> mask_range; // 掩码的二值化范围
+        bool bound = false;             // 是否裁剪周围黑边
     };
 } // namespace asst
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "Logger.hpp"
+#include "NoWarningCVMat.h"
+
+namespace asst
+{
+    // 复用截图缩放、转换颜色用到的大块内存，避免每帧都分配、释放几 MB 的内存
+    // 只有池中的 Mat 不再被外部引用（引用计数为 1）时才会再次分出去，所以调用者可以像普通的 Mat 一样随意持有
+    class FrameBufferPool
+    {
+    public:
+        static constexpr size_t DefaultMaxSize = 4;
+
+        explicit FrameBufferPool(size_t max_size = DefaultMaxSize) : m_max_size(max_size) {}
+        FrameBufferPool(const FrameBufferPool&) = delete;
+        FrameBufferPool(FrameBufferPool&&) = delete;
+        ~FrameBufferPool() = default;
+
+        cv::Mat acquire(cv::Size size, int type)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            cv::Mat* idle = nullptr;
+            for (cv::Mat& buf : m_buffers) {
+                if (!is_idle(buf)) {
+                    continue;
+                }
+                if (buf.size() == size && buf.type() == type) {
+                    return buf;
+                }
+                idle = &buf;
+            }
+
+            ++m_alloc_count;
+            Log.trace("FrameBufferPool allocate", size.width, "x", size.height, ", type", type, ", total allocated",
+                      m_alloc_count);
+            cv::Mat buf(size, type);
+            if (idle) {
+                // 尺寸不对的空闲内存直接换掉，例如切换了分辨率
+                *idle = buf;
+            }
+            else if (m_buffers.size() < m_max_size) {
+                m_buffers.emplace_back(buf);
+            }
+            // 池满了，并且都在被使用，就不放进池里了，用完直接释放
+            return buf;
+        }
+
+        // 累计分配了多少次内存，稳定运行时应当不再增长
+        size_t alloc_count() const
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            return m_alloc_count;
+        }
+
+        FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+        FrameBufferPool& operator=(FrameBufferPool&&) = delete;
+
+    private:
+        static bool is_idle(const cv::Mat& buf) { return buf.u != nullptr && buf.u->refcount == 1; }
+
+        mutable std::mutex m_mutex;
+        std::vector<cv::Mat> m_buffers;
+        size_t m_max_size = DefaultMaxSize;
+        size_t m_alloc_count = 0;
+    };
+}
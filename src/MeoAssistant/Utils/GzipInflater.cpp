@@ -0,0 +1,84 @@
+#include "GzipInflater.h"
+
+#include <limits>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4068)
+#endif
+#include <zlib/decompress.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+struct asst::GzipInflater::Stream
+{
+    gzip::z_stream zs {};
+    bool inited = false;
+};
+
+asst::GzipInflater::GzipInflater(char* output, size_t capacity)
+    : m_stream(std::make_unique<Stream>()), m_output(output), m_capacity(capacity)
+{
+    using namespace gzip;
+
+    auto& zs = m_stream->zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    zs.avail_in = 0;
+    zs.next_in = Z_NULL;
+
+    // 与 gzip::Decompressor 一致，自动识别 gzip / zlib 头
+    constexpr int WindowBits = 15 + 32;
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+#endif
+    m_stream->inited = inflateInit2(&zs, WindowBits) == Z_OK;
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+    m_failed = !m_stream->inited;
+}
+
+asst::GzipInflater::~GzipInflater()
+{
+    if (m_stream->inited) {
+        gzip::inflateEnd(&m_stream->zs);
+    }
+}
+
+bool asst::GzipInflater::feed(std::string_view chunk)
+{
+    using namespace gzip;
+
+    if (m_failed || m_finished) {
+        // 解压完之后的数据直接忽略
+        return !m_failed;
+    }
+
+    auto& zs = m_stream->zs;
+    while (!chunk.empty()) {
+        size_t in_size = (std::min)(chunk.size(), static_cast<size_t>((std::numeric_limits<uInt>::max)()));
+        zs.next_in = reinterpret_cast<z_const Bytef*>(chunk.data());
+        zs.avail_in = static_cast<uInt>(in_size);
+        zs.next_out = reinterpret_cast<Bytef*>(m_output + m_size);
+        zs.avail_out = static_cast<uInt>(m_capacity - m_size);
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        m_size = m_capacity - zs.avail_out;
+        chunk.remove_prefix(in_size - zs.avail_in);
+
+        if (ret == Z_STREAM_END) {
+            m_finished = true;
+            break;
+        }
+        // 输出空间用完了但还有数据，说明解压结果比预期的大
+        if (ret != Z_OK || zs.avail_out == 0) {
+            m_failed = true;
+            break;
+        }
+    }
+    return !m_failed;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace asst
+{
+    // 流式解压 gzip / zlib 数据：数据边到达边解压，直接写入调用者提供的定长内存
+    // 既不需要先攒齐全部压缩数据，也不需要额外的输出缓冲区
+    class GzipInflater
+    {
+    public:
+        GzipInflater(char* output, size_t capacity);
+        GzipInflater(const GzipInflater&) = delete;
+        GzipInflater(GzipInflater&&) = delete;
+        ~GzipInflater();
+
+        // 输入一段压缩数据；数据有误或者解压结果超过 capacity 时返回 false，之后的输入都会被忽略
+        bool feed(std::string_view chunk);
+
+        bool finished() const noexcept { return m_finished; }
+        bool failed() const noexcept { return m_failed; }
+        // 已经写入 output 的字节数
+        size_t size() const noexcept { return m_size; }
+
+        GzipInflater& operator=(const GzipInflater&) = delete;
+        GzipInflater& operator=(GzipInflater&&) = delete;
+
+    private:
+        struct Stream;
+        std::unique_ptr<Stream> m_stream;
+        char* m_output = nullptr;
+        size_t m_capacity = 0;
+        size_t m_size = 0;
+        bool m_finished = false;
+        bool m_failed = false;
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+
+#include "NoWarningCV.h"
+#include "NoWarningCVMat.h"
+
+namespace asst::utils
+{
+    // FNV-1a，64 位足够区分一次运行中的所有截图
+    inline constexpr uint64_t SignatureSeed = 14695981039346656037ULL;
+
+    inline uint64_t hash_combine(uint64_t hash, const void* data, size_t len)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    inline uint64_t hash_combine(uint64_t hash, std::string_view str)
+    {
+        return hash_combine(hash, str.data(), str.size());
+    }
+
+    // 图像内容（包括尺寸和类型）的哈希，逐字节计算
+    inline uint64_t hash_image(const cv::Mat& image, uint64_t hash = SignatureSeed)
+    {
+        int header[3] = { image.cols, image.rows, image.type() };
+        hash = hash_combine(hash, header, sizeof(header));
+        size_t row_size = static_cast<size_t>(image.cols) * image.elemSize();
+        for (int r = 0; r < image.rows; ++r) {
+            hash = hash_combine(hash, image.ptr<uchar>(r), row_size);
+        }
+        return hash;
+    }
+
+    // 区域缩小后的哈希，用于快速判断画面有没有变化。每 Scale x Scale 个像素取平均，
+    // 文字、图标的变化都会改变平均值；和模板匹配、OCR 相比，这点计算量可以忽略
+    inline uint64_t roi_signature(const cv::Mat& image, cv::Rect roi, uint64_t hash = SignatureSeed)
+    {
+        static constexpr int Scale = 4;
+        roi &= cv::Rect(0, 0, image.cols, image.rows);
+        int rect[4] = { roi.x, roi.y, roi.width, roi.height };
+        hash = hash_combine(hash, rect, sizeof(rect));
+        if (roi.empty()) {
+            return hash;
+        }
+        cv::Size small_size((std::max)(roi.width / Scale, 1), (std::max)(roi.height / Scale, 1));
+        cv::Mat small;
+        cv::resize(image(roi), small, small_size, 0.0, 0.0, cv::INTER_AREA);
+        return hash_image(small, hash);
+    }
+}
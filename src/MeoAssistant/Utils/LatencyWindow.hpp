@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace asst
+{
+    // 最近若干次耗时的滑动窗口，用于统计 p50、p95 等分位数。旧的数据会被新的覆盖，能反映出长时间运行中的变化
+    class LatencyWindow
+    {
+    public:
+        static constexpr size_t Capacity = 64;
+
+        void add(int64_t ms)
+        {
+            m_samples[m_next] = ms;
+            m_next = (m_next + 1) % Capacity;
+            m_size = (std::min)(m_size + 1, Capacity);
+        }
+
+        // percent 取值 0 ~ 100，窗口为空时返回 -1
+        int64_t percentile(int percent) const
+        {
+            if (m_size == 0) {
+                return -1;
+            }
+            std::array<int64_t, Capacity> sorted = m_samples;
+            auto end = sorted.begin() + static_cast<std::ptrdiff_t>(m_size);
+            size_t index = (m_size - 1) * static_cast<size_t>(std::clamp(percent, 0, 100)) / 100;
+            auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(index);
+            std::nth_element(sorted.begin(), nth, end);
+            return *nth;
+        }
+
+        size_t size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+
+    private:
+        std::array<int64_t, Capacity> m_samples {};
+        size_t m_next = 0;
+        size_t m_size = 0;
+    };
+}
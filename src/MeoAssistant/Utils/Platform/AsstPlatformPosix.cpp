@@ -2,11 +2,21 @@
 #include "AsstPlatformPosix.h"
 #include "AsstPlatform.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 
+extern char** environ;
+
 static size_t get_page_size()
 {
     return (size_t)sysconf(_SC_PAGESIZE);
@@ -24,65 +34,229 @@ void asst::platform::aligned_free(void* ptr)
     free(ptr);
 }
 
+bool asst::posix::create_pipe_cloexec(int fds[2])
+{
+#ifdef __linux__
+    return ::pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (::pipe(fds) != 0) {
+        return false;
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+bool asst::posix::write_all_no_sigpipe(int fd, std::string_view data)
+{
+    sigset_t sigpipe_set;
+    sigemptyset(&sigpipe_set);
+    sigaddset(&sigpipe_set, SIGPIPE);
+
+    // 调用前就已经挂起的 SIGPIPE 不是这里产生的，不能替调用者取走
+    sigset_t pending_set;
+    sigpending(&pending_set);
+    const bool pending_before = sigismember(&pending_set, SIGPIPE) == 1;
+
+    sigset_t old_set;
+    pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+
+    bool broken_pipe = false;
+    while (!data.empty()) {
+        ssize_t write_num = ::write(fd, data.data(), data.size());
+        if (write_num < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            broken_pipe = errno == EPIPE;
+            break;
+        }
+        data.remove_prefix(static_cast<size_t>(write_num));
+    }
+    const int write_errno = errno;
+
+    // EPIPE 时内核同时向本线程发了 SIGPIPE，恢复信号掩码前先取走，否则解除屏蔽的瞬间进程还是会被杀掉
+    if (broken_pipe && !pending_before) {
+        sigpending(&pending_set);
+        if (sigismember(&pending_set, SIGPIPE) == 1) {
+            int sig = 0;
+            sigwait(&sigpipe_set, &sig);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+
+    errno = write_errno;
+    return data.empty();
+}
+
+pid_t asst::posix::spawn_shell(const std::string& cmdline, int stdin_fd, int stdout_fd, int stderr_fd)
+{
+    posix_spawn_file_actions_t actions;
+    if (::posix_spawn_file_actions_init(&actions) != 0) {
+        return -1;
+    }
+    posix_spawnattr_t attr;
+    if (::posix_spawnattr_init(&attr) != 0) {
+        ::posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    // dup2 出来的标准输入输出不带 FD_CLOEXEC，其他 fd 都由 create_pipe_cloexec 保证在 exec 时关闭
+    ::posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    ::posix_spawn_file_actions_adddup2(&actions, stderr_fd, STDERR_FILENO);
+
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    sigaddset(&default_signals, SIGPIPE);
+    ::posix_spawnattr_setsigmask(&attr, &empty_mask);
+    ::posix_spawnattr_setsigdefault(&attr, &default_signals);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    ::posix_spawnattr_setflags(&attr, flags);
+
+    pid_t child = -1;
+    char sh[] = "sh";
+    char c_opt[] = "-c";
+    char* argv[] = { sh, c_opt, const_cast<char*>(cmdline.c_str()), nullptr };
+    int ret = ::posix_spawnp(&child, sh, &actions, &attr, argv, environ);
+
+    ::posix_spawnattr_destroy(&attr);
+    ::posix_spawn_file_actions_destroy(&actions);
+    return ret == 0 ? child : -1;
+}
+
+int asst::posix::wait_child_output(pid_t child, int read_fd, std::string& output, int64_t timeout,
+                                   const std::function<bool()>& interrupt)
+{
+    return wait_child_output(
+        child, read_fd, [&](std::string_view chunk) { output.append(chunk); }, timeout, interrupt);
+}
+
+int asst::posix::wait_child_output(pid_t child, int read_fd, const std::function<void(std::string_view)>& on_output,
+                                   int64_t timeout, const std::function<bool()>& interrupt)
+{
+    using namespace std::chrono;
+
+    // 子进程退出了，但它 fork 出来的进程（例如被 adb 拉起的 server）可能还持有管道的写端，一直读不到 EOF，
+    // 所以每隔一段时间检查一下子进程是否已经退出。正常情况下子进程退出时就会读到 EOF，不受这个间隔影响
+    constexpr int64_t ExitCheckInterval = 100;
+
+    platform::single_page_buffer<char> buffer;
+    auto start_time = steady_clock::now();
+    auto remaining_time = [&]() -> int64_t {
+        return timeout - duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+    };
+
+    int status = 0;
+    bool exited = false;
+    bool pipe_eof = false;
+    bool canceled = false;
+
+    auto read_once = [&]() -> ssize_t {
+        ssize_t read_num = ::read(read_fd, buffer.get(), buffer.size());
+        if (read_num > 0) {
+            on_output(std::string_view(buffer.get(), static_cast<size_t>(read_num)));
+        }
+        return read_num;
+    };
+
+    while (!pipe_eof && !exited) {
+        int64_t wait_time = ExitCheckInterval;
+        if (timeout > 0) {
+            int64_t remaining = remaining_time();
+            if (remaining <= 0) {
+                canceled = true;
+                break;
+            }
+            wait_time = (std::min)(wait_time, remaining);
+        }
+        if (interrupt && interrupt()) {
+            canceled = true;
+            break;
+        }
+
+        pollfd pfd { .fd = read_fd, .events = POLLIN, .revents = 0 };
+        int poll_ret = ::poll(&pfd, 1, static_cast<int>(wait_time));
+        if (poll_ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            canceled = true;
+            break;
+        }
+        if (poll_ret == 0) {
+            exited = ::waitpid(child, &status, WNOHANG) == child;
+            continue;
+        }
+        ssize_t read_num = read_once();
+        if (read_num == 0 || (read_num < 0 && errno != EINTR)) {
+            pipe_eof = true;
+        }
+    }
+
+    if (exited) {
+        // 退出前写入的数据可能还没读完
+        pollfd pfd { .fd = read_fd, .events = POLLIN, .revents = 0 };
+        while (::poll(&pfd, 1, 0) > 0 && read_once() > 0) {
+        }
+        return status;
+    }
+
+    if (pipe_eof) {
+        // 读到 EOF 一般说明子进程正在退出
+        while (!canceled) {
+            pid_t wait_ret = ::waitpid(child, &status, timeout > 0 ? WNOHANG : 0);
+            if (wait_ret == child) {
+                return status;
+            }
+            if (wait_ret < 0 && errno != EINTR) {
+                return -1;
+            }
+            if (timeout > 0 && remaining_time() <= 0) {
+                canceled = true;
+                break;
+            }
+            std::this_thread::sleep_for(milliseconds(1));
+        }
+    }
+
+    ::kill(child, SIGKILL);
+    ::waitpid(child, &status, 0);
+    return status;
+}
+
 std::string asst::platform::callcmd(const std::string& cmdline)
 {
-    constexpr int PipeBuffSize = 4096;
     std::string pipe_str;
-    auto pipe_buffer = std::make_unique<char[]>(PipeBuffSize);
 
     constexpr static int PIPE_READ = 0;
     constexpr static int PIPE_WRITE = 1;
     int pipe_in[2] = { 0 };
     int pipe_out[2] = { 0 };
-    int pipe_in_ret = pipe(pipe_in);
-    int pipe_out_ret = pipe(pipe_out);
-    if (pipe_in_ret != 0 || pipe_out_ret != 0) {
+    if (!posix::create_pipe_cloexec(pipe_in)) {
         return {};
     }
-    fcntl(pipe_out[PIPE_READ], F_SETFL, O_NONBLOCK);
-    int exit_ret = 0;
-    int child = fork();
-    if (child == 0) {
-        // child process
-        dup2(pipe_in[PIPE_READ], STDIN_FILENO);
-        dup2(pipe_out[PIPE_WRITE], STDOUT_FILENO);
-        dup2(pipe_out[PIPE_WRITE], STDERR_FILENO);
-
-        // all these are for use by parent only
+    if (!posix::create_pipe_cloexec(pipe_out)) {
         close(pipe_in[PIPE_READ]);
         close(pipe_in[PIPE_WRITE]);
-        close(pipe_out[PIPE_READ]);
-        close(pipe_out[PIPE_WRITE]);
-
-        exit_ret = execlp("sh", "sh", "-c", cmdline.c_str(), nullptr);
-        exit(exit_ret);
+        return {};
     }
-    else if (child > 0) {
-        // parent process
-
-        // close unused file descriptors, these are for child only
-        close(pipe_in[PIPE_READ]);
-        close(pipe_out[PIPE_WRITE]);
+    pid_t child = posix::spawn_shell(cmdline, pipe_in[PIPE_READ], pipe_out[PIPE_WRITE], pipe_out[PIPE_WRITE]);
 
-        do {
-            ssize_t read_num = read(pipe_out[PIPE_READ], pipe_buffer.get(), PipeBuffSize);
-
-            while (read_num > 0) {
-                pipe_str.append(pipe_buffer.get(), pipe_buffer.get() + read_num);
-                read_num = read(pipe_out[PIPE_READ], pipe_buffer.get(), PipeBuffSize);
-            };
-        } while (::waitpid(child, &exit_ret, WNOHANG) == 0);
-
-        close(pipe_in[PIPE_WRITE]);
-        close(pipe_out[PIPE_READ]);
-    }
-    else {
-        // failed to create child process
-        close(pipe_in[PIPE_READ]);
-        close(pipe_in[PIPE_WRITE]);
-        close(pipe_out[PIPE_READ]);
-        close(pipe_out[PIPE_WRITE]);
+    // close unused file descriptors, these are for child only
+    close(pipe_in[PIPE_READ]);
+    close(pipe_out[PIPE_WRITE]);
+    if (child > 0) {
+        posix::wait_child_output(child, pipe_out[PIPE_READ], pipe_str);
     }
+    close(pipe_in[PIPE_WRITE]);
+    close(pipe_out[PIPE_READ]);
     return pipe_str;
 }
 
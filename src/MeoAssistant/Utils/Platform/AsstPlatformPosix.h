@@ -1,4 +1,35 @@
 #pragma once
 #if __has_include(<unistd.h>)
 
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+namespace asst::posix
+{
+    // 创建两端都带 FD_CLOEXEC 的管道，避免被其他线程同时 fork 出来的子进程继承，导致读不到 EOF
+    // 子进程里 dup2 到标准输入输出的 fd 不会带上这个标志
+    bool create_pipe_cloexec(int fds[2]);
+
+    // 把 data 全部写入 fd，写入期间在调用线程屏蔽 SIGPIPE
+    // 读端已经关闭（例如子进程已退出）时返回 false 并且 errno 为 EPIPE，而不是整个进程被信号杀掉
+    bool write_all_no_sigpipe(int fd, std::string_view data);
+
+    // 用 posix_spawn 执行 sh -c cmdline，并把子进程的标准输入、输出、错误分别重定向到给定的 fd
+    // 进程里映射了 OCR 模型和大量模板，fork 复制页表的开销很大；glibc 的 posix_spawn 基于 vfork 语义，不需要复制
+    // 子进程的信号掩码会被清空（调用线程可能屏蔽了 SIGPIPE），返回子进程 pid，失败返回 -1
+    pid_t spawn_shell(const std::string& cmdline, int stdin_fd, int stdout_fd, int stderr_fd);
+
+    // 用 poll 阻塞等待子进程的输出，直到读到 EOF 并回收子进程，不再空转占满一个核
+    // timeout 单位为毫秒，<= 0 表示不限时；超时或 interrupt 返回 true 时会杀掉子进程
+    // 返回 waitpid 得到的 status，出错返回 -1
+    int wait_child_output(pid_t child, int read_fd, std::string& output, int64_t timeout = 0,
+                          const std::function<bool()>& interrupt = nullptr);
+    // 同上，但输出每读到一段就交给 on_output 处理，不保存
+    int wait_child_output(pid_t child, int read_fd, const std::function<void(std::string_view)>& on_output,
+                          int64_t timeout = 0, const std::function<bool()>& interrupt = nullptr);
+}
+
 #endif
@@ -0,0 +1,68 @@
+#include "TextReplacer.h"
+
+#include <algorithm>
+
+bool asst::TextReplacer::add(std::string pattern, std::string replacement)
+{
+    const auto is_same_pattern = [&](const Rule& rule) { return rule.pattern == pattern; };
+    if (std::ranges::any_of(m_rules, is_same_pattern)) {
+        // 与原来用 unordered_map 存规则时一致，重复的规则只保留第一条
+        return true;
+    }
+
+    Rule rule;
+    rule.type = classify(pattern, replacement);
+    if (rule.type == RuleType::Regex) {
+        try {
+            rule.regex.emplace(pattern);
+        }
+        catch (const std::regex_error&) {
+            return false;
+        }
+    }
+    rule.pattern = std::move(pattern);
+    rule.replacement = std::move(replacement);
+    m_rules.emplace_back(std::move(rule));
+    return true;
+}
+
+void asst::TextReplacer::apply(std::string& text) const
+{
+    for (const Rule& rule : m_rules) {
+        switch (rule.type) {
+        case RuleType::Literal:
+            // 与 regex_replace 一样，从左往右替换所有不重叠的匹配
+            for (size_t pos = text.find(rule.pattern); pos != std::string::npos;
+                 pos = text.find(rule.pattern, pos + rule.replacement.size())) {
+                text.replace(pos, rule.pattern.size(), rule.replacement);
+            }
+            break;
+        case RuleType::Exact:
+            if (text == std::string_view(rule.pattern).substr(1, rule.pattern.size() - 2)) {
+                text = rule.replacement;
+            }
+            break;
+        case RuleType::Regex:
+            text = std::regex_replace(text, *rule.regex, rule.replacement);
+            break;
+        }
+    }
+}
+
+asst::TextReplacer::RuleType asst::TextReplacer::classify(std::string_view pattern,
+                                                          std::string_view replacement) noexcept
+{
+    // 替换串里的 $ 可能是 $1、$& 之类的引用，交给 regex_replace 处理
+    if (pattern.empty() || replacement.find('$') != std::string_view::npos) {
+        return RuleType::Regex;
+    }
+    constexpr std::string_view Special = R"(\^$.|?*+()[]{})";
+    if (pattern.find_first_of(Special) == std::string_view::npos) {
+        return RuleType::Literal;
+    }
+    if (pattern.size() > 2 && pattern.front() == '^' && pattern.back() == '$' &&
+        pattern.substr(1, pattern.size() - 2).find_first_of(Special) == std::string_view::npos) {
+        return RuleType::Exact;
+    }
+    return RuleType::Regex;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace asst
+{
+    // 一组预先编译好的文字替换规则（tasks.json 中的 ocrReplace），按加入的顺序依次应用
+    // 大部分规则其实是纯文字或 "^文字$" 的整句替换，这两种直接比较字符串，不经过 std::regex
+    class TextReplacer
+    {
+    public:
+        enum class RuleType
+        {
+            Literal, // 替换所有出现的子串
+            Exact,   // "^文字$"，整句相同时替换
+            Regex,
+        };
+
+        struct Rule
+        {
+            std::string pattern; // 原样保存 tasks.json 中的写法
+            std::string replacement;
+            RuleType type = RuleType::Regex;
+            std::optional<std::regex> regex; // 只有 Regex 类型才编译
+        };
+
+        // 正则有误时返回 false，规则不会被加入
+        bool add(std::string pattern, std::string replacement);
+        void apply(std::string& text) const;
+
+        bool empty() const noexcept { return m_rules.empty(); }
+        size_t size() const noexcept { return m_rules.size(); }
+        const std::vector<Rule>& rules() const noexcept { return m_rules; }
+
+    private:
+        static RuleType classify(std::string_view pattern, std::string_view replacement) noexcept;
+
+        std::vector<Rule> m_rules;
+    };
+}
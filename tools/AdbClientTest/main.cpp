@@ -0,0 +1,321 @@
+// 用一个回放固定回复的假 adb server 测试 AdbClient，不需要真的 adb 和设备
+// 每个请求的回复见下面的 transcript()，格式与 SERVICES.TXT 中描述的一致
+
+#ifdef _WIN32
+#include "Utils/Platform/SafeWindows.h"
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "AdbClient.h"
+
+namespace
+{
+#ifdef _WIN32
+    using socket_t = SOCKET;
+    constexpr socket_t InvalidSocket = INVALID_SOCKET;
+    void close_socket(socket_t sock)
+    {
+        ::closesocket(sock);
+    }
+#else
+    using socket_t = int;
+    constexpr socket_t InvalidSocket = -1;
+    void close_socket(socket_t sock)
+    {
+        ::close(sock);
+    }
+#endif
+
+    constexpr std::string_view Serial = "emulator-5554";
+    constexpr std::string_view OldSerial = "old-device"; // 不支持 shell_v2 的设备
+    constexpr size_t ScreencapSize = 3 * 1024 * 1024 + 17;
+
+    std::string hex_prefixed(std::string_view payload)
+    {
+        char len_buf[5] = { 0 };
+        std::snprintf(len_buf, sizeof(len_buf), "%04zx", payload.size());
+        return std::string(len_buf, 4) + std::string(payload);
+    }
+
+    std::string shell_v2_packet(char id, std::string_view payload)
+    {
+        std::string packet(1, id);
+        auto len = static_cast<uint32_t>(payload.size());
+        for (int i = 0; i < 4; ++i) {
+            packet.push_back(static_cast<char>((len >> (8 * i)) & 0xFF));
+        }
+        return packet + std::string(payload);
+    }
+
+    std::string screencap_data()
+    {
+        std::string data(ScreencapSize, '\0');
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i * 31 % 251);
+        }
+        return data;
+    }
+
+    struct Reply
+    {
+        std::string data;
+        bool expect_close_stdin = false; // shell,v2 服务回复 OKAY 后，要先收到客户端的 close stdin 包
+        bool echo = false;               // 之后把收到的数据原样发回去，直到客户端断开
+    };
+
+    // 服务名 -> 回复，transport 成功后同一条连接上的下一个请求也在这里查
+    const std::map<std::string, Reply, std::less<>>& transcript()
+    {
+        static const std::map<std::string, Reply, std::less<>> replies = {
+            { "host:version", { "OKAY" + hex_prefixed("0029") } },
+            { "host:connect:127.0.0.1:5555", { "OKAY" + hex_prefixed("connected to 127.0.0.1:5555") } },
+            { "host:kill", { "OKAY" } },
+            { "host-serial:emulator-5554:features", { "OKAY" + hex_prefixed("cmd,shell_v2,stat_v2") } },
+            { "host-serial:old-device:features", { "OKAY" + hex_prefixed("cmd") } },
+            { "host:transport:emulator-5554", { "OKAY" } },
+            { "host:transport:old-device", { "OKAY" } },
+            { "shell,v2,raw:echo hello",
+              { "OKAY" + shell_v2_packet(1, "hello\n") + shell_v2_packet(2, "warning\n") +
+                    shell_v2_packet(3, std::string_view("\0", 1)),
+                true } },
+            { "shell,v2,raw:false", { "OKAY" + shell_v2_packet(3, "\x01"), true } },
+            { "shell,v2,raw:crash", { "OKAY" + shell_v2_packet(1, "partial"), true } },
+            { "shell:echo hello", { "OKAY" "hello\n" } },
+            { "exec:screencap", { "OKAY" + screencap_data() } },
+            { "exec:cat", { "OKAY", false, true } },
+        };
+        return replies;
+    }
+
+    bool recv_exact(socket_t sock, char* buf, size_t len)
+    {
+        while (len > 0) {
+            auto read_num = ::recv(sock, buf, static_cast<int>(len), 0);
+            if (read_num <= 0) {
+                return false;
+            }
+            buf += read_num;
+            len -= static_cast<size_t>(read_num);
+        }
+        return true;
+    }
+
+    bool send_all(socket_t sock, std::string_view data)
+    {
+        while (!data.empty()) {
+            auto sent = ::send(sock, data.data(), static_cast<int>(data.size()), 0);
+            if (sent <= 0) {
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(sent));
+        }
+        return true;
+    }
+
+    void serve_connection(socket_t sock)
+    {
+        while (true) {
+            char len_buf[5] = { 0 };
+            if (!recv_exact(sock, len_buf, 4)) {
+                break;
+            }
+            std::string service(std::strtoul(len_buf, nullptr, 16), '\0');
+            if (!recv_exact(sock, service.data(), service.size())) {
+                break;
+            }
+            auto iter = transcript().find(service);
+            if (iter == transcript().cend()) {
+                send_all(sock, "FAIL" + hex_prefixed("unknown service " + service));
+                break;
+            }
+            const Reply& reply = iter->second;
+            std::string_view data = reply.data;
+            if (reply.expect_close_stdin) {
+                // 先回复 OKAY，客户端收到后才会发 close stdin 包
+                send_all(sock, data.substr(0, 4));
+                data.remove_prefix(4);
+                char packet[5] = { 0 };
+                if (!recv_exact(sock, packet, sizeof(packet)) || packet[0] != 4) {
+                    std::cerr << "expect close stdin packet for " << service << std::endl;
+                    break;
+                }
+            }
+            send_all(sock, data);
+            if (reply.echo) {
+                char buf[256];
+                while (true) {
+                    auto read_num = ::recv(sock, buf, sizeof(buf), 0);
+                    if (read_num <= 0 || !send_all(sock, std::string_view(buf, static_cast<size_t>(read_num)))) {
+                        break;
+                    }
+                }
+                break;
+            }
+            // 只有 transport 之后连接还要继续用，其他服务回复完就关闭
+            if (!service.starts_with("host:transport:")) {
+                break;
+            }
+        }
+        close_socket(sock);
+    }
+
+    class FakeAdbServer
+    {
+    public:
+        FakeAdbServer()
+        {
+            m_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = 0;
+            ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            socklen_t addr_len = sizeof(addr);
+            if (::bind(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+                ::listen(m_socket, 8) != 0 ||
+                ::getsockname(m_socket, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0) {
+                std::cerr << "fake server listen failed" << std::endl;
+                std::exit(1);
+            }
+            m_port = ntohs(addr.sin_port);
+            m_thread = std::thread([this]() {
+                while (true) {
+                    socket_t client = ::accept(m_socket, nullptr, nullptr);
+                    if (client == InvalidSocket || m_exit) {
+                        if (client != InvalidSocket) {
+                            close_socket(client);
+                        }
+                        break;
+                    }
+                    std::thread(serve_connection, client).detach();
+                }
+            });
+        }
+        FakeAdbServer(const FakeAdbServer&) = delete;
+        FakeAdbServer(FakeAdbServer&&) = delete;
+        ~FakeAdbServer()
+        {
+            // 连自己一下，让 accept 返回
+            m_exit = true;
+            socket_t wake = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in addr {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(m_port);
+            ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            ::connect(wake, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+            m_thread.join();
+            close_socket(wake);
+            close_socket(m_socket);
+        }
+
+        unsigned short port() const noexcept { return m_port; }
+
+        FakeAdbServer& operator=(const FakeAdbServer&) = delete;
+        FakeAdbServer& operator=(FakeAdbServer&&) = delete;
+
+    private:
+        socket_t m_socket = InvalidSocket;
+        unsigned short m_port = 0;
+        std::atomic<bool> m_exit = false;
+        std::thread m_thread;
+    };
+
+    int failures = 0;
+
+    void check(bool condition, std::string_view what)
+    {
+        std::cout << (condition ? "[PASS] " : "[FAIL] ") << what << std::endl;
+        if (!condition) {
+            ++failures;
+        }
+    }
+}
+
+int main()
+{
+    // AdbClient 的构造函数里会初始化 Winsock，要在假 server 之前创建
+    asst::AdbClient winsock_holder("127.0.0.1", 0);
+    FakeAdbServer server;
+    asst::AdbClient adb("127.0.0.1", server.port());
+    constexpr int64_t Timeout = 5000;
+
+    check(adb.available(Timeout), "host:version");
+    check(adb.host_request("host:connect:127.0.0.1:5555", Timeout) == "connected to 127.0.0.1:5555",
+          "host:connect reply");
+    check(adb.host_request("host:kill", Timeout) == "", "host:kill closes without payload");
+    check(!adb.host_request("host:no-such-service", Timeout), "FAIL reply");
+
+    {
+        // 从不 accept 的 server：第一条连接占满 backlog 后，之后的握手请求会被丢弃，connect 得不到回应
+        // 这时 connect 要么报错，要么等到超时，都不能一直卡住
+        socket_t silent = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        socket_t filler = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        ::inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        socklen_t addr_len = sizeof(addr);
+        ::bind(silent, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        ::listen(silent, 0);
+        ::getsockname(silent, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+        ::connect(filler, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+
+        auto start = std::chrono::steady_clock::now();
+        bool available = asst::AdbClient("127.0.0.1", ntohs(addr.sin_port)).available(300);
+        check(!available && std::chrono::steady_clock::now() - start < std::chrono::seconds(3),
+              "connect respects timeout");
+        close_socket(filler);
+        close_socket(silent);
+    }
+
+    check(adb.has_feature(std::string(Serial), "shell_v2", Timeout), "features include shell_v2");
+    check(!adb.has_feature(std::string(Serial), "shell", Timeout), "feature names match exactly");
+    check(!adb.has_feature(std::string(OldSerial), "shell_v2", Timeout), "old device has no shell_v2");
+
+    auto hello = adb.shell(std::string(Serial), "echo hello", Timeout);
+    check(hello && hello->output == "hello\nwarning\n" && hello->exit_code == 0, "shell,v2 output and exit code 0");
+    auto failed = adb.shell(std::string(Serial), "false", Timeout);
+    check(failed && failed->exit_code == 1, "shell,v2 exit code 1");
+    check(!adb.shell(std::string(Serial), "crash", Timeout), "shell,v2 without exit packet fails");
+    auto old_hello = adb.shell(std::string(OldSerial), "echo hello", Timeout);
+    check(old_hello && old_hello->output == "hello\n" && !old_hello->exit_code, "shell: fallback without exit code");
+
+    const std::string expected = screencap_data();
+    check(adb.transport_request(std::string(Serial), "exec:screencap", Timeout) == expected, "exec: full output");
+    std::string streamed;
+    size_t chunks = 0;
+    auto streamed_ret = adb.transport_request(std::string(Serial), "exec:screencap", Timeout,
+                                              [&](std::string_view chunk) {
+                                                  streamed.append(chunk);
+                                                  ++chunks;
+                                              });
+    check(streamed_ret == "" && streamed == expected && chunks > 1, "exec: streamed output");
+    check(!adb.transport_request("no-such-device", "exec:screencap", Timeout), "unknown transport");
+
+    auto stream = adb.open_transport(std::string(Serial), "exec:cat", Timeout);
+    char echoed[4] = { 0 };
+    check(stream && stream->write("ping", Timeout) && stream->read_exact(echoed, sizeof(echoed), Timeout) &&
+              std::string_view(echoed, sizeof(echoed)) == "ping",
+          "open_transport read/write");
+
+    if (failures) {
+        std::cout << "FAILED: " << failures << std::endl;
+        return 1;
+    }
+    std::cout << "ALL PASSED" << std::endl;
+    return 0;
+}
@@ -0,0 +1,291 @@
+// 不需要设备和资源的性能测试，-DBUILD_TEST=ON 编译后运行：
+//   Benchmark callcmd [次数]   等待子进程输出时父进程自身占用的 CPU 时间，对比原来空转的 waitpid(WNOHANG) 循环
+//   Benchmark spawn [MB...]    先占用这么多 MB 的内存（默认 0 256 1024），再对比 fork 和 posix_spawn 启动子进程的耗时
+//   Benchmark gzip [次数] [文件] 解压一帧截图，对比攒齐数据后 gzip::decompress 和 GzipInflater 边收边解压
+//                              文件为设备上 `screencap | gzip -1` 的输出，不指定时用合成的 1080p 画面（压缩率比真实画面高很多）
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Utils/Platform/AsstPlatformPosix.h"
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4068)
+#endif
+#include <zlib/decompress.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "Utils/GzipInflater.h"
+#include "Utils/Platform.hpp"
+
+namespace
+{
+    using Args = std::vector<std::string>;
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+#ifndef _WIN32
+    // 本进程（不含子进程）累计占用的 CPU 时间，毫秒
+    double self_cpu_ms()
+    {
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        auto to_ms = [](const timeval& tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; };
+        return to_ms(usage.ru_utime) + to_ms(usage.ru_stime);
+    }
+
+    // 原来的等待方式：非阻塞地读管道，waitpid(WNOHANG) 返回 0 就继续循环
+    std::string callcmd_busy_wait(const std::string& cmdline)
+    {
+        int pipe_in[2] = { 0 };
+        int pipe_out[2] = { 0 };
+        if (!asst::posix::create_pipe_cloexec(pipe_in)) {
+            return {};
+        }
+        if (!asst::posix::create_pipe_cloexec(pipe_out)) {
+            close(pipe_in[0]);
+            close(pipe_in[1]);
+            return {};
+        }
+        fcntl(pipe_out[0], F_SETFL, O_NONBLOCK);
+        pid_t child = asst::posix::spawn_shell(cmdline, pipe_in[0], pipe_out[1], pipe_out[1]);
+        close(pipe_in[0]);
+        close(pipe_out[1]);
+
+        std::string output;
+        if (child > 0) {
+            char buffer[4096];
+            int status = 0;
+            do {
+                ssize_t read_num = read(pipe_out[0], buffer, sizeof(buffer));
+                while (read_num > 0) {
+                    output.append(buffer, static_cast<size_t>(read_num));
+                    read_num = read(pipe_out[0], buffer, sizeof(buffer));
+                }
+            } while (waitpid(child, &status, WNOHANG) == 0);
+        }
+        close(pipe_in[1]);
+        close(pipe_out[0]);
+        return output;
+    }
+#endif
+
+    int bench_callcmd(const Args& args)
+    {
+#ifdef _WIN32
+        std::ignore = args;
+        std::cerr << "callcmd benchmark is POSIX only" << std::endl;
+        return 1;
+#else
+        const int times = args.empty() ? 3 : (std::max)(std::atoi(args[0].c_str()), 1);
+        const std::string cmdline = "sleep 1";
+        auto measure = [&](std::string_view name, const std::function<std::string(const std::string&)>& call) {
+            double cpu_start = self_cpu_ms();
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < times; ++i) {
+                call(cmdline);
+            }
+            double wall = elapsed_ms(start);
+            double cpu = self_cpu_ms() - cpu_start;
+            std::cout << name << ": `" << cmdline << "` x " << times << ", wall " << wall / times
+                      << " ms, self cpu " << cpu / times << " ms per call" << std::endl;
+        };
+        measure("busy wait", callcmd_busy_wait);
+        measure("poll", asst::platform::callcmd);
+        return 0;
+#endif
+    }
+
+#ifndef _WIN32
+    // 原来的启动方式：fork 之后 execlp，需要复制父进程的页表
+    pid_t spawn_by_fork(const std::string& cmdline)
+    {
+        pid_t child = fork();
+        if (child == 0) {
+            execlp("sh", "sh", "-c", cmdline.c_str(), nullptr);
+            _exit(127);
+        }
+        return child;
+    }
+
+    pid_t spawn_by_posix_spawn(const std::string& cmdline)
+    {
+        return asst::posix::spawn_shell(cmdline, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO);
+    }
+#endif
+
+    int bench_spawn(const Args& args)
+    {
+#ifdef _WIN32
+        std::ignore = args;
+        std::cerr << "spawn benchmark is POSIX only" << std::endl;
+        return 1;
+#else
+        std::vector<size_t> sizes_mb = { 0, 256, 1024 };
+        if (!args.empty()) {
+            sizes_mb.clear();
+            for (const std::string& arg : args) {
+                sizes_mb.emplace_back(std::strtoull(arg.c_str(), nullptr, 10));
+            }
+        }
+        constexpr int Times = 50;
+        const std::string cmdline = "true";
+        auto measure = [&](const std::function<pid_t(const std::string&)>& spawn) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Times; ++i) {
+                pid_t child = spawn(cmdline);
+                int status = 0;
+                if (child > 0) {
+                    waitpid(child, &status, 0);
+                }
+            }
+            return elapsed_ms(start) / Times;
+        };
+
+        for (size_t size_mb : sizes_mb) {
+            // 写一遍，确保真的映射了物理内存，fork 时要复制这些页表
+            const size_t size = size_mb * 1024 * 1024;
+            auto memory = std::make_unique<char[]>((std::max)(size, size_t(1)));
+            std::memset(memory.get(), 1, size);
+
+            rusage usage {};
+            getrusage(RUSAGE_SELF, &usage);
+            double fork_ms = measure(spawn_by_fork);
+            double posix_spawn_ms = measure(spawn_by_posix_spawn);
+            std::cout << "extra " << size_mb << " MB (max rss " << usage.ru_maxrss / 1024 << " MB): fork " << fork_ms
+                      << " ms, posix_spawn " << posix_spawn_ms << " ms per launch of `" << cmdline << "`"
+                      << std::endl;
+        }
+        return 0;
+#endif
+    }
+
+    // 模拟 screencap 输出：12 字节头 + 1920x1080 RGBA，压缩等级和 gzip -1 一样
+    std::string make_compressed_frame(std::string& raw)
+    {
+        constexpr size_t Width = 1920;
+        constexpr size_t Height = 1080;
+        raw.assign(12 + Width * Height * 4, '\0');
+        for (size_t i = 12; i < raw.size(); ++i) {
+            size_t pixel = (i - 12) / 4;
+            raw[i] = static_cast<char>((pixel % Width) / 8 + (pixel / Width) / 8 * 3 + (i % 4) * 64);
+        }
+        auto bound = gzip::compressBound(static_cast<gzip::uLong>(raw.size()));
+        std::string compressed(bound, '\0');
+        auto* dest = reinterpret_cast<gzip::Bytef*>(compressed.data());
+        auto* source = reinterpret_cast<const gzip::Bytef*>(raw.data());
+        if (gzip::compress2(dest, &bound, source, static_cast<gzip::uLong>(raw.size()), 1) != Z_OK) {
+            return {};
+        }
+        compressed.resize(bound);
+        return compressed;
+    }
+
+    // 录制的 `screencap | gzip -1` 输出，raw 为解压后的内容，作为对比的基准
+    std::string load_compressed_frame(const std::string& path, std::string& raw)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        std::string compressed((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (compressed.empty()) {
+            return {};
+        }
+        try {
+            raw = gzip::decompress(compressed.data(), compressed.size());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "decompress " << path << " failed: " << e.what() << std::endl;
+            return {};
+        }
+        return compressed;
+    }
+
+    int bench_gzip(const Args& args)
+    {
+        const int times = args.empty() ? 20 : (std::max)(std::atoi(args[0].c_str()), 1);
+        std::string raw;
+        const std::string compressed =
+            args.size() > 1 ? load_compressed_frame(args[1], raw) : make_compressed_frame(raw);
+        if (compressed.empty() || raw.empty()) {
+            std::cerr << (args.size() > 1 ? "load " + args[1] + " failed" : "compress failed") << std::endl;
+            return 1;
+        }
+        // 和 adb 的管道一样按 64K 一块到达
+        constexpr size_t ChunkSize = 64 * 1024;
+
+        auto start = std::chrono::steady_clock::now();
+        bool buffered_ok = true;
+        for (int i = 0; i < times; ++i) {
+            std::string received;
+            for (size_t pos = 0; pos < compressed.size(); pos += ChunkSize) {
+                received.append(std::string_view(compressed).substr(pos, ChunkSize));
+            }
+            buffered_ok &= gzip::decompress(received.data(), received.size()) == raw;
+        }
+        double buffered_ms = elapsed_ms(start) / times;
+
+        start = std::chrono::steady_clock::now();
+        bool streaming_ok = true;
+        std::string output(raw.size(), '\0');
+        for (int i = 0; i < times; ++i) {
+            asst::GzipInflater inflater(output.data(), output.size());
+            for (size_t pos = 0; pos < compressed.size() && !inflater.failed(); pos += ChunkSize) {
+                inflater.feed(std::string_view(compressed).substr(pos, ChunkSize));
+            }
+            streaming_ok &= inflater.finished() && inflater.size() == raw.size() && output == raw;
+        }
+        double streaming_ms = elapsed_ms(start) / times;
+
+        std::cout << (args.size() > 1 ? args[1] : "synthetic frame") << ": " << raw.size() << " bytes, compressed "
+                  << compressed.size() << " bytes, x " << times << std::endl;
+        std::cout << "buffered: " << buffered_ms << " ms per frame" << (buffered_ok ? "" : " (MISMATCH)")
+                  << std::endl;
+        std::cout << "streaming: " << streaming_ms << " ms per frame" << (streaming_ok ? "" : " (MISMATCH)")
+                  << std::endl;
+        return buffered_ok && streaming_ok ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const std::map<std::string, std::function<int(const Args&)>> benchmarks = {
+        { "callcmd", bench_callcmd },
+        { "gzip", bench_gzip },
+        { "spawn", bench_spawn },
+    };
+
+    if (argc < 2 || !benchmarks.contains(argv[1])) {
+        std::cerr << "usage: " << argv[0] << " <benchmark> [args...], benchmarks:";
+        for (const auto& [name, func] : benchmarks) {
+            std::cerr << " " << name;
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    return benchmarks.at(argv[1])(Args(argv + 2, argv + argc));
+}